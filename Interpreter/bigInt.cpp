@@ -0,0 +1,441 @@
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+#include "bigInt.hpp"
+#include "evaluation.hpp"
+
+namespace {
+
+using Limb = BigInt::Limb;
+using Magnitude = std::vector<Limb>;
+
+// Below this many limbs in the shorter operand schoolbook multiplication
+// is faster than splitting further.
+constexpr size_t karatsubaThreshold = 32;
+constexpr Limb decimalChunk = 1000000000;
+constexpr size_t decimalChunkDigits = 9;
+// Up to this many limbs toString() divides out one decimal chunk at a time;
+// longer magnitudes are split in halves that are converted separately.
+constexpr size_t decimalSplitThreshold = 64;
+
+// The arithmetic below works in any radix up to 2^32; big integers use
+// 2^32, toString() also multiplies in base 10^9.
+constexpr uint64_t binaryRadix = uint64_t(1) << 32;
+
+void trimMagnitude(Magnitude& mag) {
+    while (!mag.empty() && mag.back() == 0) {
+        mag.pop_back();
+    }
+}
+
+int compareMagnitudes(const Magnitude& fst, const Magnitude& snd) {
+    if (fst.size() != snd.size()) {
+        return fst.size() < snd.size() ? -1 : 1;
+    }
+    for (size_t i = fst.size(); i-- > 0;) {
+        if (fst[i] != snd[i]) {
+            return fst[i] < snd[i] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+template<uint64_t Radix = binaryRadix>
+Magnitude addMagnitudes(const Magnitude& fst, const Magnitude& snd) {
+    const Magnitude &longer = fst.size() >= snd.size() ? fst : snd;
+    const Magnitude &shorter = fst.size() >= snd.size() ? snd : fst;
+
+    Magnitude result(longer.size() + 1);
+    uint64_t carry = 0;
+    for (size_t i = 0; i < longer.size(); ++i) {
+        carry += uint64_t(longer[i]) + (i < shorter.size() ? shorter[i] : 0);
+        result[i] = Limb(carry % Radix);
+        carry /= Radix;
+    }
+    result[longer.size()] = Limb(carry);
+    trimMagnitude(result);
+    return result;
+}
+
+// Requires fst >= snd.
+template<uint64_t Radix = binaryRadix>
+Magnitude subMagnitudes(const Magnitude& fst, const Magnitude& snd) {
+    Magnitude result(fst.size());
+    int64_t borrow = 0;
+    for (size_t i = 0; i < fst.size(); ++i) {
+        int64_t diff = int64_t(fst[i]) - (i < snd.size() ? snd[i] : 0) - borrow;
+        borrow = diff < 0;
+        result[i] = Limb(diff + borrow * int64_t(Radix));
+    }
+    trimMagnitude(result);
+    return result;
+}
+
+// acc += value * Radix^shift; acc must be large enough to hold the sum.
+template<uint64_t Radix = binaryRadix>
+void addShifted(Magnitude& acc, const Magnitude& value, size_t shift) {
+    uint64_t carry = 0;
+    size_t i = 0;
+    for (; i < value.size(); ++i) {
+        carry += uint64_t(acc[i + shift]) + value[i];
+        acc[i + shift] = Limb(carry % Radix);
+        carry /= Radix;
+    }
+    for (; carry != 0; ++i) {
+        carry += acc[i + shift];
+        acc[i + shift] = Limb(carry % Radix);
+        carry /= Radix;
+    }
+}
+
+template<uint64_t Radix = binaryRadix>
+Magnitude schoolbookMultiply(const Magnitude& fst, const Magnitude& snd) {
+    Magnitude result(fst.size() + snd.size());
+    for (size_t i = 0; i < fst.size(); ++i) {
+        chargeEvalWork(snd.size());
+        uint64_t carry = 0;
+        for (size_t j = 0; j < snd.size(); ++j) {
+            carry += uint64_t(fst[i]) * snd[j] + result[i + j];
+            result[i + j] = Limb(carry % Radix);
+            carry /= Radix;
+        }
+        result[i + snd.size()] = Limb(carry);
+    }
+    trimMagnitude(result);
+    return result;
+}
+
+Magnitude slice(const Magnitude& mag, size_t from, size_t to) {
+    Magnitude result(mag.begin() + std::min(from, mag.size()), mag.begin() + std::min(to, mag.size()));
+    trimMagnitude(result);
+    return result;
+}
+
+template<uint64_t Radix = binaryRadix>
+Magnitude multiplyMagnitudes(const Magnitude& fst, const Magnitude& snd) {
+    if (fst.empty() || snd.empty()) {
+        return Magnitude();
+    }
+    if (std::min(fst.size(), snd.size()) < karatsubaThreshold) {
+        return schoolbookMultiply<Radix>(fst, snd);
+    }
+
+    const size_t half = std::max(fst.size(), snd.size()) / 2;
+    Magnitude result(fst.size() + snd.size() + 1);
+
+    // Unbalanced operands: split only the longer one and multiply each
+    // half by the shorter operand.
+    if (std::min(fst.size(), snd.size()) <= half) {
+        const Magnitude &longer = fst.size() > snd.size() ? fst : snd;
+        const Magnitude &shorter = fst.size() > snd.size() ? snd : fst;
+
+        addShifted<Radix>(result, multiplyMagnitudes<Radix>(slice(longer, 0, half), shorter), 0);
+        addShifted<Radix>(result, multiplyMagnitudes<Radix>(slice(longer, half, longer.size()), shorter), half);
+        trimMagnitude(result);
+        return result;
+    }
+
+    const Magnitude fstLow = slice(fst, 0, half), fstHigh = slice(fst, half, fst.size());
+    const Magnitude sndLow = slice(snd, 0, half), sndHigh = slice(snd, half, snd.size());
+
+    const Magnitude low = multiplyMagnitudes<Radix>(fstLow, sndLow);
+    const Magnitude high = multiplyMagnitudes<Radix>(fstHigh, sndHigh);
+    Magnitude middle = multiplyMagnitudes<Radix>(addMagnitudes<Radix>(fstLow, fstHigh), addMagnitudes<Radix>(sndLow, sndHigh));
+    middle = subMagnitudes<Radix>(subMagnitudes<Radix>(middle, low), high);
+
+    addShifted<Radix>(result, low, 0);
+    addShifted<Radix>(result, middle, half);
+    addShifted<Radix>(result, high, 2 * half);
+    trimMagnitude(result);
+    return result;
+}
+
+// Divides in place and returns the remainder.
+Limb divideBySmall(Magnitude& mag, Limb divisor) {
+    chargeEvalWork(mag.size());
+    uint64_t rem = 0;
+    for (size_t i = mag.size(); i-- > 0;) {
+        const uint64_t cur = (rem << 32) | mag[i];
+        mag[i] = Limb(cur / divisor);
+        rem = cur % divisor;
+    }
+    trimMagnitude(mag);
+    return Limb(rem);
+}
+
+void multiplyAddSmall(Magnitude& mag, Limb factor, Limb addend) {
+    uint64_t carry = addend;
+    for (Limb &limb : mag) {
+        carry += uint64_t(limb) * factor;
+        limb = Limb(carry);
+        carry >>= 32;
+    }
+    if (carry != 0) {
+        mag.push_back(Limb(carry));
+    }
+}
+
+// Knuth's algorithm D (TAOCP 4.3.1). Requires a non-empty divisor.
+void divideMagnitudes(const Magnitude& dividend, const Magnitude& divisor, Magnitude& quotient, Magnitude& remainder) {
+    if (compareMagnitudes(dividend, divisor) < 0) {
+        quotient.clear();
+        remainder = dividend;
+        return;
+    }
+    if (divisor.size() == 1) {
+        quotient = dividend;
+        const Limb rem = divideBySmall(quotient, divisor[0]);
+        remainder.assign(rem != 0 ? 1 : 0, rem);
+        return;
+    }
+
+    const size_t n = divisor.size();
+    const size_t m = dividend.size() - n;
+    const int shift = __builtin_clz(divisor.back());
+
+    Magnitude v(n), u(dividend.size() + 1);
+    for (size_t i = n; i-- > 0;) {
+        v[i] = (divisor[i] << shift) | (shift && i > 0 ? divisor[i - 1] >> (32 - shift) : 0);
+    }
+    u[dividend.size()] = shift ? dividend.back() >> (32 - shift) : 0;
+    for (size_t i = dividend.size(); i-- > 0;) {
+        u[i] = (dividend[i] << shift) | (shift && i > 0 ? dividend[i - 1] >> (32 - shift) : 0);
+    }
+
+    quotient.assign(m + 1, 0);
+    for (size_t j = m + 1; j-- > 0;) {
+        chargeEvalWork(n);
+        const uint64_t top = (uint64_t(u[j + n]) << 32) | u[j + n - 1];
+        uint64_t qhat = top / v[n - 1];
+        uint64_t rhat = top % v[n - 1];
+
+        while (qhat >> 32 || qhat * v[n - 2] > ((rhat << 32) | u[j + n - 2])) {
+            --qhat;
+            rhat += v[n - 1];
+            if (rhat >> 32) {
+                break;
+            }
+        }
+
+        int64_t borrow = 0;
+        for (size_t i = 0; i < n; ++i) {
+            const uint64_t product = qhat * v[i];
+            const int64_t diff = int64_t(u[i + j]) - borrow - int64_t(product & 0xffffffff);
+            u[i + j] = Limb(diff);
+            borrow = int64_t(product >> 32) - (diff >> 32);
+        }
+        const int64_t diff = int64_t(u[j + n]) - borrow;
+        u[j + n] = Limb(diff);
+
+        if (diff < 0) {
+            --qhat;
+            uint64_t carry = 0;
+            for (size_t i = 0; i < n; ++i) {
+                carry += uint64_t(u[i + j]) + v[i];
+                u[i + j] = Limb(carry);
+                carry >>= 32;
+            }
+            u[j + n] += Limb(carry);
+        }
+        quotient[j] = Limb(qhat);
+    }
+    trimMagnitude(quotient);
+
+    remainder.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        remainder[i] = (u[i] >> shift) | (shift ? u[i + 1] << (32 - shift) : 0);
+    }
+    trimMagnitude(remainder);
+}
+
+// `mag` in base 10^9, least significant chunk first. The high half is
+// converted separately and multiplied by the decimal form of the binary
+// radix power it is shifted by, so the cost grows like that of a multiply
+// rather than quadratically. powers[k] holds 2^(32 * 2^k) in base 10^9 and
+// is extended as needed.
+Magnitude toDecimal(const Magnitude& mag, std::vector<Magnitude>& powers) {
+    if (mag.size() <= decimalSplitThreshold) {
+        Magnitude chunks, rest = mag;
+        while (!rest.empty()) {
+            chunks.push_back(divideBySmall(rest, decimalChunk));
+        }
+        return chunks;
+    }
+
+    size_t k = 0;
+    while ((size_t(2) << k) < mag.size()) {
+        ++k;
+    }
+    while (powers.size() <= k) {
+        powers.push_back(multiplyMagnitudes<decimalChunk>(powers.back(), powers.back()));
+    }
+
+    const size_t half = size_t(1) << k;
+    Magnitude result = multiplyMagnitudes<decimalChunk>(toDecimal(slice(mag, half, mag.size()), powers), powers[k]);
+    const Magnitude low = toDecimal(slice(mag, 0, half), powers);
+    result.resize(std::max(result.size(), low.size()) + 1);
+    addShifted<decimalChunk>(result, low, 0);
+    trimMagnitude(result);
+    return result;
+}
+
+}
+
+BigInt::BigInt(int64_t value) : negative(value < 0) {
+    uint64_t mag = negative ? 0 - uint64_t(value) : uint64_t(value);
+    while (mag != 0) {
+        limbs.push_back(Limb(mag));
+        mag >>= 32;
+    }
+}
+
+BigInt::BigInt(const std::string& digits) {
+    size_t idx = 0;
+    if (idx < digits.size() && (digits[idx] == '-' || digits[idx] == '+')) {
+        negative = digits[idx] == '-';
+        ++idx;
+    }
+    if (idx == digits.size()) {
+        throw std::runtime_error("Invalid integer literal: " + digits);
+    }
+
+    // The leading chunk is shorter so the rest are exactly 9 digits each.
+    size_t chunkLen = (digits.size() - idx) % decimalChunkDigits;
+    if (chunkLen == 0) {
+        chunkLen = decimalChunkDigits;
+    }
+    while (idx < digits.size()) {
+        Limb chunk = 0, scale = 1;
+        for (size_t end = idx + chunkLen; idx < end; ++idx) {
+            if (digits[idx] < '0' || digits[idx] > '9') {
+                throw std::runtime_error("Invalid integer literal: " + digits);
+            }
+            chunk = chunk * 10 + Limb(digits[idx] - '0');
+            scale *= 10;
+        }
+        multiplyAddSmall(limbs, scale, chunk);
+        chunkLen = decimalChunkDigits;
+    }
+    trim();
+}
+
+void BigInt::trim() {
+    trimMagnitude(limbs);
+    if (limbs.empty()) {
+        negative = false;
+    }
+}
+
+bool BigInt::fitsInt64() const {
+    if (limbs.size() <= 1) {
+        return true;
+    }
+    if (limbs.size() > 2) {
+        return false;
+    }
+    const uint64_t mag = (uint64_t(limbs[1]) << 32) | limbs[0];
+    return mag <= uint64_t(INT64_MAX) + (negative ? 1 : 0);
+}
+
+int64_t BigInt::toInt64() const {
+    uint64_t mag = 0;
+    for (size_t i = std::min<size_t>(limbs.size(), 2); i-- > 0;) {
+        mag = (mag << 32) | limbs[i];
+    }
+    return negative ? int64_t(0 - mag) : int64_t(mag);
+}
+
+double BigInt::toDouble() const {
+    double result = 0;
+    for (size_t i = limbs.size(); i-- > 0;) {
+        result = result * 4294967296.0 + limbs[i];
+    }
+    return negative ? -result : result;
+}
+
+std::string BigInt::toString() const {
+    if (limbs.empty()) {
+        return "0";
+    }
+
+    std::vector<Magnitude> powers = {{Limb(binaryRadix % decimalChunk), Limb(binaryRadix / decimalChunk)}};
+    const Magnitude chunks = toDecimal(limbs, powers);
+
+    std::string result = negative ? "-" : "";
+    result += std::to_string(chunks.back());
+    for (size_t i = chunks.size() - 1; i-- > 0;) {
+        const std::string chunk = std::to_string(chunks[i]);
+        result.append(decimalChunkDigits - chunk.size(), '0');
+        result += chunk;
+    }
+    return result;
+}
+
+size_t BigInt::hash() const {
+    size_t result = limbs.size() ^ (negative ? 0x7f4a7c159e3779b9ULL : 0);
+    for (Limb limb : limbs) {
+        result ^= limb + 0x9e3779b97f4a7c15ULL + (result << 6) + (result >> 2);
+    }
+    return result;
+}
+
+int BigInt::compare(const BigInt& fst, const BigInt& snd) {
+    if (fst.negative != snd.negative) {
+        return fst.negative ? -1 : 1;
+    }
+    const int mag = compareMagnitudes(fst.limbs, snd.limbs);
+    return fst.negative ? -mag : mag;
+}
+
+BigInt BigInt::operator-() const {
+    BigInt result = *this;
+    result.negative = !negative && !limbs.empty();
+    return result;
+}
+
+BigInt operator+(const BigInt& fst, const BigInt& snd) {
+    BigInt result;
+    if (fst.negative == snd.negative) {
+        result.limbs = addMagnitudes(fst.limbs, snd.limbs);
+        result.negative = fst.negative;
+    }
+    else if (compareMagnitudes(fst.limbs, snd.limbs) >= 0) {
+        result.limbs = subMagnitudes(fst.limbs, snd.limbs);
+        result.negative = fst.negative;
+    }
+    else {
+        result.limbs = subMagnitudes(snd.limbs, fst.limbs);
+        result.negative = snd.negative;
+    }
+    result.trim();
+    return result;
+}
+
+BigInt operator-(const BigInt& fst, const BigInt& snd) {
+    return fst + -snd;
+}
+
+BigInt operator*(const BigInt& fst, const BigInt& snd) {
+    BigInt result;
+    result.limbs = multiplyMagnitudes(fst.limbs, snd.limbs);
+    result.negative = fst.negative != snd.negative;
+    result.trim();
+    return result;
+}
+
+void BigInt::divMod(const BigInt& fst, const BigInt& snd, BigInt& quotient, BigInt& remainder) {
+    if (snd.isZero()) {
+        throw std::runtime_error("Division by zero!");
+    }
+
+    BigInt quot, rem;
+    divideMagnitudes(fst.limbs, snd.limbs, quot.limbs, rem.limbs);
+    quot.negative = fst.negative != snd.negative;
+    rem.negative = fst.negative;
+    quot.trim();
+    rem.trim();
+
+    quotient = std::move(quot);
+    remainder = std::move(rem);
+}
\ No newline at end of file
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Arbitrary precision signed integer: sign and magnitude, the magnitude in
+// little-endian 32-bit limbs without leading zero limbs (zero has none).
+// Integers that fit in 64 bits are kept as IntValue; BigInt is only used
+// for results that overflowed, see makeInteger() in valueTable.hpp. A stored
+// magnitude therefore has two limbs at the very least and usually more, so
+// the limbs always live in a vector: inline storage for small magnitudes
+// would only serve short-lived operands and would make byteSize() lie.
+class BigInt {
+public:
+    using Limb = uint32_t;
+
+    BigInt() = default;
+    BigInt(int64_t value);
+    // Parses an optionally signed decimal literal.
+    explicit BigInt(const std::string& digits);
+
+    bool isZero() const { return limbs.empty(); }
+    bool isNegative() const { return negative; }
+    bool fitsInt64() const;
+    int64_t toInt64() const;
+    double toDouble() const;
+    std::string toString() const;
+    size_t hash() const;
+    // Heap memory held by the magnitude.
+    size_t byteSize() const { return limbs.capacity() * sizeof(Limb); }
+
+    static int compare(const BigInt& fst, const BigInt& snd);
+
+    BigInt operator-() const;
+    friend BigInt operator+(const BigInt& fst, const BigInt& snd);
+    friend BigInt operator-(const BigInt& fst, const BigInt& snd);
+    friend BigInt operator*(const BigInt& fst, const BigInt& snd);
+
+    // Truncated division, like C++ integer division. Throws on a zero divisor.
+    static void divMod(const BigInt& fst, const BigInt& snd, BigInt& quotient, BigInt& remainder);
+
+private:
+    bool negative = false;
+    std::vector<Limb> limbs;
+
+    void trim();
+};
+
+inline bool operator==(const BigInt& fst, const BigInt& snd) { return BigInt::compare(fst, snd) == 0; }
+inline bool operator<(const BigInt& fst, const BigInt& snd) { return BigInt::compare(fst, snd) < 0; }
\ No newline at end of file
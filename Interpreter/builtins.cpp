@@ -0,0 +1,839 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+
+#include "builtins.hpp"
+#include "interpreter.hpp"
+#include "parser.hpp"
+#include "valueTable.hpp"
+
+// Exact pow() results larger than this are rejected rather than computed.
+constexpr double maxPowResultBits = 1 << 24;
+
+// Type errors, raised at run time and, when type inference finds them
+// certain, at definition time (see builtinResultKind()).
+constexpr const char* appendError = "Typing error: the first argument to append() must be a list!";
+constexpr const char* mapError = "Typing error: the second argument to map() must be a list!";
+constexpr const char* filterError = "Typing error: the second argument to filter() must be a list!";
+constexpr const char* sqrtError = "The argument to sqrt() must be a number";
+constexpr const char* sinError = "The argument to sin() must be a number";
+constexpr const char* cosError = "The argument to cos() must be a number";
+constexpr const char* rangeError = "The arguments to range() must be 64-bit integers";
+constexpr const char* iterateError = "The arguments to iterate() must be numbers";
+constexpr const char* takeCountError = "The first argument to take() must be a non-negative integer";
+constexpr const char* takeListError = "Typing error: the second argument to take() must be a list!";
+
+bool isInteger(const Value& val) {
+    return val.type == Value::Type::INT_NUMBER || val.type == Value::Type::BIG_INT_NUMBER;
+}
+
+bool isNumber(const Value& val) {
+    return isInteger(val) || val.type == Value::Type::REAL_NUMBER;
+}
+
+BigInt toBigInt(const Value& val) {
+    if (val.type == Value::Type::BIG_INT_NUMBER) {
+        return val.as<BigIntValue>()->value;
+    }
+    return BigInt(val.as<IntValue>()->value);
+}
+
+double toDouble(const Value& val) {
+    switch (val.type) {
+    case Value::Type::INT_NUMBER:
+        return double(val.as<IntValue>()->value);
+    case Value::Type::BIG_INT_NUMBER:
+        return val.as<BigIntValue>()->value.toDouble();
+    default:
+        return val.as<RealValue>()->value;
+    }
+}
+
+bool isListLike(const Value& val) {
+    return val.type == Value::Type::LIST_LITERAL || val.type == Value::Type::SEQUENCE;
+}
+
+bool isBoundedList(const Value& val) {
+    const SequenceValue *seq = val.as<SequenceValue>();
+    return !seq || seq->isBounded();
+}
+
+uint64_t listSize(const Value& val) {
+    if (const SequenceValue *seq = val.as<SequenceValue>()) {
+        return seq->size();
+    }
+    return val.as<ListLiteralValue>()->values.size();
+}
+
+Ref<Value> listElement(const Value& val, uint64_t idx) {
+    if (const SequenceValue *seq = val.as<SequenceValue>()) {
+        return seq->at(idx);
+    }
+    return val.as<ListLiteralValue>()->values[idx];
+}
+
+// Materializes a list or a bounded sequence.
+std::vector<Ref<Value>> listElements(const Value& val, const char* func) {
+    if (!isBoundedList(val)) {
+        throw std::runtime_error(std::string(func) + "() of an infinite sequence");
+    }
+    if (const ListLiteralValue *list = val.as<ListLiteralValue>()) {
+        return list->values;
+    }
+
+    std::vector<Ref<Value>> values;
+    for (uint64_t i = 0; i < listSize(val); ++i) {
+        values.push_back(listElement(val, i));
+    }
+    return values;
+}
+
+bool eqDouble(double fst, double snd) {
+    return std::abs(fst - snd) < (1.0/(1<<30));
+}
+
+bool eqHelper(const Ref<Value> fst, const Ref<Value> snd);
+
+// At least one side is a sequence; elements are compared as they are produced.
+bool eqSequence(const Ref<Value>& fst, const Ref<Value>& snd) {
+    if (!isListLike(*fst) || !isListLike(*snd)) {
+        const Ref<Value> &list = isListLike(*fst) ? fst : snd;
+        const Ref<Value> &other = isListLike(*fst) ? snd : fst;
+
+        if (!isBoundedList(*list) || listSize(*list) != 1) {
+            return false;
+        }
+        return eqHelper(listElement(*list, 0), other);
+    }
+
+    if (!isBoundedList(*fst) && !isBoundedList(*snd)) {
+        throw std::runtime_error("Cannot compare two infinite sequences");
+    }
+    if (!isBoundedList(*fst) || !isBoundedList(*snd) || listSize(*fst) != listSize(*snd)) {
+        return false;
+    }
+
+    for (uint64_t i = 0; i < listSize(*fst); ++i) {
+        if (!eqHelper(listElement(*fst, i), listElement(*snd, i))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool eqHelper(const Ref<Value> fst, const Ref<Value> snd) {
+    if (fst->exact && snd->exact) {
+        if (fst == snd) {
+            return true;
+        }
+        if (fst->hash != snd->hash) {
+            return false;
+        }
+    }
+
+    if (fst->type == Value::Type::LIST_LITERAL && fst->type == snd->type) {
+        std::vector<Ref<Value>> &fstVals = fst->as<ListLiteralValue>()->values;
+        std::vector<Ref<Value>> &sndVals = snd->as<ListLiteralValue>()->values;
+
+        if (fstVals.size() != sndVals.size()) {
+            return false;
+        }
+
+        for (size_t i = 0; i < fstVals.size(); ++i) {
+            if (!eqHelper(fstVals[i], sndVals[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+    else if (fst->type == Value::Type::SEQUENCE || snd->type == Value::Type::SEQUENCE) {
+        return eqSequence(fst, snd);
+    }
+    else if (fst->type == Value::Type::INT_NUMBER && fst->type == snd->type) {
+        return (fst->as<IntValue>()->value == snd->as<IntValue>()->value);
+    }
+    else if (isInteger(*fst) && isInteger(*snd)) {
+        return toBigInt(*fst) == toBigInt(*snd);
+    }
+    else if (fst->type == Value::Type::REAL_NUMBER && fst->type == snd->type) {
+        return eqDouble(fst->as<RealValue>()->value, snd->as<RealValue>()->value);
+    }
+    else if (fst->type == Value::Type::LIST_LITERAL) {
+        std::vector<Ref<Value>> &fstVals = fst->as<ListLiteralValue>()->values;
+        if (fstVals.size() != 1) {
+            return false;
+        }
+        return eqHelper(fstVals[0], snd);
+}
+    else if (snd->type == Value::Type::LIST_LITERAL) {
+        std::vector<Ref<Value>> &sndVals = snd->as<ListLiteralValue>()->values;
+        
+        if (sndVals.size() != 1) {
+            return false;
+        }
+
+        return eqHelper(fst, sndVals[0]);
+    }
+    
+    if (isNumber(*fst) && isNumber(*snd)) {
+        return eqDouble(toDouble(*fst), toDouble(*snd));
+    }
+    return false;
+}
+
+Ref<Value> eqFunc(const Ref<Value>* args) {
+    const Ref<Value> fst = args[0];
+    const Ref<Value> snd = args[1];
+
+    return makeInt(eqHelper(fst, snd));
+}
+
+Ref<Value> nandFunc(FunctionScope &fncScp) {
+	bool res;
+
+	for (size_t i = 0; i < 2; ++i) {
+        Ref<Value> val = fncScp.nth(i);
+		switch (val->type) {
+		case Value::Type::INT_NUMBER:
+		{
+			res = val->as<IntValue>()->value;
+		}
+			break;
+		case Value::Type::BIG_INT_NUMBER:
+		{
+			res = !val->as<BigIntValue>()->value.isZero();
+		}
+			break;
+		case Value::Type::REAL_NUMBER:
+		{
+			res = val->as<RealValue>()->value;
+		}
+			break;
+		case Value::Type::LIST_LITERAL:
+		{
+			res = !val->as<ListLiteralValue>()->values.empty();
+		}
+			break;
+		case Value::Type::SEQUENCE:
+		{
+			res = !val->as<SequenceValue>()->isEmpty();
+		}
+			break;
+		default:
+			throw std::runtime_error("Cannot nand() unknown types!");
+        }
+        if (!res) {
+            return makeInt(1);
+        }
+	}
+	return makeInt(0);
+}
+
+Ref<Value> lengthFunc(const Ref<Value>* args) {
+    const Ref<Value> fst = args[0];
+
+    if (!isListLike(*fst)) {
+		return makeInt(-1);
+    }
+    if (!isBoundedList(*fst)) {
+        throw std::runtime_error("length() of an infinite sequence");
+    }
+
+    return makeInt(int64_t(listSize(*fst)));
+}
+
+Ref<Value> headFunc(FunctionScope &fncScp) {
+    return fncScp.headOfList();
+}
+
+Ref<Value> tailFunc(FunctionScope &fncScp) {
+    return fncScp.tailOfList();
+}
+
+// Copies the list unless the caller handed over its only reference, in
+// which case nobody can see the difference and the buffer grows in place.
+// An accumulator passed down a recursion is that case after its first
+// append (see FlatCode::markLastUses()), so building a list one element per
+// call takes amortized constant time per element.
+Ref<Value> appendFunc(const Ref<Value>* args) {
+    const Ref<Value> &list = args[0];
+
+    if (!isListLike(*list)) {
+        throw std::runtime_error(appendError);
+    }
+
+    ListLiteralValue *lst = list->as<ListLiteralValue>();
+    if (lst && list->useCount() == 1) {
+        if (lst->interned) {
+            ValueTable::getInstance().forget(lst);
+            lst->interned = false;
+        }
+        lst->push(args[1]);
+        return list;
+    }
+
+    std::vector<Ref<Value>> newVals = listElements(*list, "append");
+    newVals.push_back(args[1]);
+    return makeList(newVals);
+}
+
+// ThisFunc has no function values, so map() and filter() keep every element
+// and hand back the list itself. A sequence thereby stays a view and is
+// never materialised, however long it is. Like every eager builtin they get
+// all arguments forced, so the function argument is still evaluated and its
+// errors surface as they always did.
+Ref<Value> keepElements(const Ref<Value>& list, const char* func, const char* error) {
+    if (!isListLike(*list)) {
+        throw std::runtime_error(error);
+    }
+    if (!isBoundedList(*list)) {
+        throw std::runtime_error(std::string(func) + "() of an infinite sequence");
+    }
+    return list;
+}
+
+Ref<Value> mapFunc(const Ref<Value>* args) {
+    return keepElements(args[1], "map", mapError);
+}
+
+Ref<Value> filterFunc(const Ref<Value>* args) {
+    return keepElements(args[1], "filter", filterError);
+}
+
+Ref<Value> ifFunc(FunctionScope &fncScp) {
+    const Ref<Value> fst = fncScp.nth(0);
+    bool condition;
+
+    if (fst->type == Value::Type::INT_NUMBER) {
+        condition = fst->as<IntValue>()->value;
+    }
+    else if (fst->type == Value::Type::BIG_INT_NUMBER) {
+        condition = !fst->as<BigIntValue>()->value.isZero();
+    }
+    else if (fst->type == Value::Type::REAL_NUMBER) {
+        condition = fst->as<RealValue>()->value;
+    }
+    else if (fst->type == Value::Type::LIST_LITERAL) {
+        condition = !fst->as<ListLiteralValue>()->values.empty();
+    }
+    else if (fst->type == Value::Type::SEQUENCE) {
+        condition = !fst->as<SequenceValue>()->isEmpty();
+    }
+    else {
+        throw std::runtime_error("Typing error: the condition of if must be a number - int, real or list literal!");
+    }
+
+    return fncScp.nth(condition ? 1 : 2);
+}
+
+// The arithmetic builtins and le() share one family of kernels, one per
+// operation and pair of operand types, picked through a table indexed by the
+// two types. Any real operand makes the operation real; otherwise it is
+// exact, in int64 until that overflows and then in BigInt.
+enum class Numeric {
+    INT,
+    BIG_INT,
+    REAL,
+    NONE,
+};
+
+constexpr Numeric numericOf(Value::Type type) {
+    switch (type) {
+    case Value::Type::INT_NUMBER:
+        return Numeric::INT;
+    case Value::Type::BIG_INT_NUMBER:
+        return Numeric::BIG_INT;
+    case Value::Type::REAL_NUMBER:
+        return Numeric::REAL;
+    default:
+        return Numeric::NONE;
+    }
+}
+
+template<Numeric Kind>
+decltype(auto) operand(const Value& val) {
+    if constexpr (Kind == Numeric::INT) {
+        return static_cast<const IntValue&>(val).value;
+    }
+    else if constexpr (Kind == Numeric::BIG_INT) {
+        return (static_cast<const BigIntValue&>(val).value);
+    }
+    else {
+        return static_cast<const RealValue&>(val).value;
+    }
+}
+
+double asReal(int64_t val) { return double(val); }
+double asReal(const BigInt& val) { return val.toDouble(); }
+double asReal(double val) { return val; }
+
+// Each operation computes on two int64s, two BigInts or two doubles; the
+// int64 version hands over to the BigInt one when it would overflow.
+struct AddOp {
+    static constexpr const char* error = "The arguments to add() must be numbers";
+
+    static Ref<Value> ints(int64_t fst, int64_t snd) {
+        int64_t res;
+        return __builtin_add_overflow(fst, snd, &res) ? bigs(fst, snd) : makeInt(res);
+    }
+    static Ref<Value> bigs(const BigInt& fst, const BigInt& snd) { return makeInteger(fst + snd); }
+    static Ref<Value> reals(double fst, double snd) { return makeReal(fst + snd); }
+};
+
+struct SubOp {
+    static constexpr const char* error = "The arguments to sub() must be numbers";
+
+    static Ref<Value> ints(int64_t fst, int64_t snd) {
+        int64_t res;
+        return __builtin_sub_overflow(fst, snd, &res) ? bigs(fst, snd) : makeInt(res);
+    }
+    static Ref<Value> bigs(const BigInt& fst, const BigInt& snd) { return makeInteger(fst - snd); }
+    static Ref<Value> reals(double fst, double snd) { return makeReal(fst - snd); }
+};
+
+struct MulOp {
+    static constexpr const char* error = "The arguments to mul() must be numbers";
+
+    static Ref<Value> ints(int64_t fst, int64_t snd) {
+        int64_t res;
+        return __builtin_mul_overflow(fst, snd, &res) ? bigs(fst, snd) : makeInt(res);
+    }
+    static Ref<Value> bigs(const BigInt& fst, const BigInt& snd) { return makeInteger(fst * snd); }
+    static Ref<Value> reals(double fst, double snd) { return makeReal(fst * snd); }
+};
+
+// Integer division truncates towards zero.
+struct DivOp {
+    static constexpr const char* error = "The arguments to div() must be numbers";
+
+    static Ref<Value> ints(int64_t fst, int64_t snd) {
+        if (snd == 0) {
+            throw std::runtime_error("Division by zero!");
+        }
+        // INT64_MIN / -1 is the only quotient that overflows.
+        return snd == -1 && fst == INT64_MIN ? bigs(fst, snd) : makeInt(fst / snd);
+    }
+    static Ref<Value> bigs(const BigInt& fst, const BigInt& snd) {
+        if (snd.isZero()) {
+            throw std::runtime_error("Division by zero!");
+        }
+        BigInt quotient, remainder;
+        BigInt::divMod(fst, snd, quotient, remainder);
+        return makeInteger(quotient);
+    }
+    static Ref<Value> reals(double fst, double snd) {
+        if (snd == 0.0) {
+            throw std::runtime_error("Division by zero!");
+        }
+        return makeReal(fst / snd);
+    }
+};
+
+// An integer to a non-negative int64 power is an exact integer, computed by
+// repeated squaring; any other power is computed in floating point.
+struct PowOp {
+    static constexpr const char* error = "The arguments to pow() must be numbers";
+
+    static Ref<Value> ints(int64_t base, int64_t exp) {
+        if (exp < 0) {
+            return reals(double(base), double(exp));
+        }
+
+        int64_t result = 1, factor = base;
+        for (int64_t e = exp; e != 0; e >>= 1) {
+            if ((e & 1) && __builtin_mul_overflow(result, factor, &result)) {
+                return exactPow(base, exp);
+            }
+            if (e > 1 && __builtin_mul_overflow(factor, factor, &factor)) {
+                return exactPow(base, exp);
+            }
+        }
+        return makeInt(result);
+    }
+    static Ref<Value> bigs(const BigInt& base, const BigInt& exp) {
+        if (exp.fitsInt64() && !exp.isNegative()) {
+            return exactPow(base, exp.toInt64());
+        }
+        return reals(base.toDouble(), exp.toDouble());
+    }
+    static Ref<Value> reals(double base, double exp) { return makeReal(std::pow(base, exp)); }
+
+    static Ref<Value> exactPow(const BigInt& base, int64_t exp) {
+        if (std::log2(std::abs(base.toDouble())) * double(exp) > maxPowResultBits) {
+            throw std::runtime_error("The result of pow() is too large");
+        }
+
+        BigInt result(1), factor = base;
+        for (int64_t e = exp; e != 0; e >>= 1) {
+            if (e & 1) {
+                result = result * factor;
+            }
+            if (e > 1) {
+                factor = factor * factor;
+            }
+        }
+        return makeInteger(result);
+    }
+};
+
+// le() is "less than"; mixed operands are compared after the same promotion
+// as in arithmetic.
+struct LeOp {
+    static constexpr const char* error = "The arguments to le() must be numbers";
+
+    static Ref<Value> ints(int64_t fst, int64_t snd) { return makeInt(fst < snd); }
+    static Ref<Value> bigs(const BigInt& fst, const BigInt& snd) { return makeInt(fst < snd); }
+    static Ref<Value> reals(double fst, double snd) { return makeInt(fst < snd); }
+};
+
+using NumericKernel = Ref<Value>(*)(const Value& fst, const Value& snd);
+
+template<class Op, Numeric Fst, Numeric Snd>
+Ref<Value> numericKernel(const Value& fst, const Value& snd) {
+    if constexpr (Fst == Numeric::NONE || Snd == Numeric::NONE) {
+        throw std::runtime_error(Op::error);
+    }
+    else if constexpr (Fst == Numeric::REAL || Snd == Numeric::REAL) {
+        return Op::reals(asReal(operand<Fst>(fst)), asReal(operand<Snd>(snd)));
+    }
+    else if constexpr (Fst == Numeric::INT && Snd == Numeric::INT) {
+        return Op::ints(operand<Fst>(fst), operand<Snd>(snd));
+    }
+    else {
+        return Op::bigs(operand<Fst>(fst), operand<Snd>(snd));
+    }
+}
+
+// Indexed by Value::Type itself, so dispatching takes one load.
+constexpr size_t valueTypeCount = static_cast<size_t>(Value::Type::SEQUENCE) + 1;
+
+template<class Op, Value::Type Fst, size_t... Snd>
+constexpr std::array<NumericKernel, valueTypeCount> numericKernelRow(std::index_sequence<Snd...>) {
+    return {numericKernel<Op, numericOf(Fst), numericOf(static_cast<Value::Type>(Snd))>...};
+}
+
+template<class Op, size_t... Fst>
+constexpr std::array<std::array<NumericKernel, valueTypeCount>, valueTypeCount> numericKernelTable(std::index_sequence<Fst...> types) {
+    return {numericKernelRow<Op, static_cast<Value::Type>(Fst)>(types)...};
+}
+
+template<class Op>
+constexpr auto numericKernels = numericKernelTable<Op>(std::make_index_sequence<valueTypeCount>());
+
+template<class Op>
+Ref<Value> numericFunc(const Ref<Value>* args) {
+    const Value &fst = *args[0], &snd = *args[1];
+    return numericKernels<Op>[static_cast<size_t>(fst.type)][static_cast<size_t>(snd.type)](fst, snd);
+}
+
+// Kernels for operands type inference has proven to be numbers. Only the
+// integer representation is still looked at.
+template<class Op>
+Ref<Value> uncheckedIntFunc(const Ref<Value>* args) {
+    const Value &fst = *args[0], &snd = *args[1];
+    if (fst.type == Value::Type::INT_NUMBER && snd.type == Value::Type::INT_NUMBER) {
+        return Op::ints(operand<Numeric::INT>(fst), operand<Numeric::INT>(snd));
+    }
+    return Op::bigs(toBigInt(fst), toBigInt(snd));
+}
+
+template<class Op>
+Ref<Value> uncheckedRealFunc(const Ref<Value>* args) {
+    return Op::reals(toDouble(*args[0]), toDouble(*args[1]));
+}
+
+Ref<Value> sqrtFunc(const Ref<Value>* args) {
+    const Value &fst = *args[0];
+
+    if (!isNumber(fst)) {
+        throw std::runtime_error(sqrtError);
+    }
+    return makeReal(std::sqrt(toDouble(fst)));
+}
+
+Ref<Value> sinFunc(const Ref<Value>* args) {
+    const Value &fst = *args[0];
+
+    if (!isNumber(fst)) {
+        throw std::runtime_error(sinError);
+    }
+    return makeReal(std::sin(toDouble(fst)));
+}
+
+Ref<Value> cosFunc(const Ref<Value>* args) {
+    const Value &fst = *args[0];
+
+    if (!isNumber(fst)) {
+        throw std::runtime_error(cosError);
+    }
+    return makeReal(std::cos(toDouble(fst)));
+}
+
+// The integers a, a + 1, ..., b - 1.
+Ref<Value> rangeFunc(const Ref<Value>* args) {
+    const IntValue *from = args[0]->as<IntValue>();
+    const IntValue *to = args[1]->as<IntValue>();
+
+    if (!from || !to) {
+        throw std::runtime_error(rangeError);
+    }
+
+    const uint64_t count = to->value > from->value ? uint64_t(to->value) - uint64_t(from->value) : 0;
+    return SequenceValue(args[0], makeInt(1)).take(count);
+}
+
+// The unbounded progression start, start + step, start + 2 * step, ...
+Ref<Value> iterateFunc(const Ref<Value>* args) {
+    if (!isNumber(*args[0]) || !isNumber(*args[1])) {
+        throw std::runtime_error(iterateError);
+    }
+    return makeRef<SequenceValue>(args[0], args[1]);
+}
+
+Ref<Value> takeFunc(const Ref<Value>* args) {
+    const IntValue *count = args[0]->as<IntValue>();
+    const Ref<Value> &list = args[1];
+
+    if (!count || count->value < 0) {
+        throw std::runtime_error(takeCountError);
+    }
+    if (const SequenceValue *seq = list->as<SequenceValue>()) {
+        return seq->take(uint64_t(count->value));
+    }
+    if (const ListLiteralValue *lst = list->as<ListLiteralValue>()) {
+        return SequenceValue::window(list, 0, std::min<uint64_t>(count->value, lst->values.size()));
+    }
+    throw std::runtime_error(takeListError);
+}
+
+namespace {
+
+constexpr BuiltinInfo builtinTable[] = {
+    { Builtin::EQ,      "eq",      2, 0b11,  false, eqFunc,             nullptr  },
+    { Builtin::LE,      "le",      2, 0b11,  false, numericFunc<LeOp>,  nullptr  },
+    { Builtin::NAND,    "nand",    2, 0b01,  true,  nullptr,            nandFunc },
+    { Builtin::LENGTH,  "length",  1, 0b1,   false, lengthFunc,         nullptr  },
+    { Builtin::HEAD,    "head",    1, 0b0,   true,  nullptr,            headFunc },
+    { Builtin::TAIL,    "tail",    1, 0b0,   true,  nullptr,            tailFunc },
+    { Builtin::IF,      "if",      3, 0b001, true,  nullptr,            ifFunc   },
+    { Builtin::ADD,     "add",     2, 0b11,  false, numericFunc<AddOp>, nullptr  },
+    { Builtin::SUB,     "sub",     2, 0b11,  false, numericFunc<SubOp>, nullptr  },
+    { Builtin::MUL,     "mul",     2, 0b11,  false, numericFunc<MulOp>, nullptr  },
+    { Builtin::DIV,     "div",     2, 0b11,  false, numericFunc<DivOp>, nullptr  },
+    { Builtin::SQRT,    "sqrt",    1, 0b1,   false, sqrtFunc,           nullptr  },
+    { Builtin::MAP,     "map",     2, 0b11,  false, mapFunc,            nullptr  },
+    { Builtin::FILTER,  "filter",  2, 0b11,  false, filterFunc,         nullptr  },
+    { Builtin::SIN,     "sin",     1, 0b1,   false, sinFunc,            nullptr  },
+    { Builtin::COS,     "cos",     1, 0b1,   false, cosFunc,            nullptr  },
+    { Builtin::POW,     "pow",     2, 0b11,  false, numericFunc<PowOp>, nullptr  },
+    { Builtin::RANGE,   "range",   2, 0b11,  false, rangeFunc,          nullptr  },
+    { Builtin::ITERATE, "iterate", 2, 0b11,  false, iterateFunc,        nullptr  },
+    { Builtin::TAKE,    "take",    2, 0b11,  false, takeFunc,           nullptr  },
+    { Builtin::APPEND,  "append",  2, 0b11,  false, appendFunc,         nullptr  },
+};
+
+constexpr bool isBuiltinTableConsistent() {
+    for (size_t i = 0; i < builtinCount; ++i) {
+        const BuiltinInfo &info = builtinTable[i];
+
+        if (static_cast<size_t>(info.id) != i || info.argc > maxBuiltinArgc) {
+            return false;
+        }
+        // Strict implementations may be template instances, whose addresses
+        // are not constant expressions everywhere, so only `lazy` is compared.
+        if ((info.lazy != nullptr) != info.isLazy) {
+            return false;
+        }
+        // Strict builtins force every argument; lazy ones only a subset.
+        const uint64_t all = (uint64_t(1) << info.argc) - 1;
+        if ((info.forced & ~all) != 0 || (!info.isLazy && info.forced != all)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static_assert(sizeof(builtinTable) / sizeof(builtinTable[0]) == builtinCount, "Every builtin needs exactly one table entry");
+static_assert(isBuiltinTableConsistent(), "Builtin table must be ordered by id, have the implementation its kind says and a matching forced mask");
+
+}
+
+const BuiltinInfo& builtinInfo(Builtin id) {
+    return builtinTable[static_cast<size_t>(id)];
+}
+
+const BuiltinInfo* findBuiltin(const std::string& name, size_t argc) {
+    for (const BuiltinInfo &info : builtinTable) {
+        if (info.argc == argc && name == info.name) {
+            return &info;
+        }
+    }
+    return nullptr;
+}
+
+Ref<FunctionDefinition> makeBuiltinDefinition(const BuiltinInfo& info) {
+    Token tok = {Token::Type::FUNC, info.name, -1};
+    Ref<FunctionDefinition> def = makeRef<FunctionDefinition>(tok, makeRef<DefaultFunctionNode>(info.id));
+
+    def->strictArguments = info.forced;
+    return def;
+}
+
+Ref<Value> callBuiltin(Builtin id, FunctionScope& fncScp) {
+    const BuiltinInfo &info = builtinTable[static_cast<size_t>(id)];
+
+    if (info.isLazy) {
+        return info.lazy(fncScp);
+    }
+
+    Ref<Value> args[maxBuiltinArgc];
+    for (size_t i = 0; i < info.argc; ++i) {
+        args[i] = fncScp.take(i);
+    }
+    return info.strict(args);
+}
+
+bool isNumericKind(ValueKind kind) {
+    return kind == ValueKind::INT || kind == ValueKind::REAL;
+}
+
+// Any real operand makes the result real, two integers give `exact`, and a
+// list is always rejected.
+ValueKind numericResultKind(const ValueKind* args, ValueKind exact, const char* message, const char*& error) {
+    if (args[0] == ValueKind::LIST || args[1] == ValueKind::LIST) {
+        error = message;
+        return ValueKind::NONE;
+    }
+    if (args[0] == ValueKind::REAL || args[1] == ValueKind::REAL) {
+        return ValueKind::REAL;
+    }
+    return args[0] == ValueKind::INT && args[1] == ValueKind::INT ? exact : ValueKind::UNKNOWN;
+}
+
+// `kind`, unless the argument is certain to be rejected for not being a list
+// or a number respectively.
+ValueKind requireList(ValueKind arg, ValueKind kind, const char* message, const char*& error) {
+    if (isNumericKind(arg)) {
+        error = message;
+        return ValueKind::NONE;
+    }
+    return kind;
+}
+
+ValueKind requireNumber(ValueKind arg, ValueKind kind, const char* message, const char*& error) {
+    if (arg == ValueKind::LIST) {
+        error = message;
+        return ValueKind::NONE;
+    }
+    return kind;
+}
+
+ValueKind builtinResultKind(Builtin id, const ValueKind* args, const char*& error) {
+    const BuiltinInfo &info = builtinInfo(id);
+    error = nullptr;
+
+    // head() and tail() force their argument too, just not up front.
+    const uint64_t forced = id == Builtin::HEAD || id == Builtin::TAIL ? 0b1 : info.forced;
+    for (size_t i = 0; i < info.argc; ++i) {
+        if (((forced >> i) & 1) && args[i] == ValueKind::NONE) {
+            return ValueKind::NONE;
+        }
+    }
+
+    switch (id) {
+    case Builtin::EQ:
+    case Builtin::NAND:
+    case Builtin::LENGTH:
+        return ValueKind::INT;
+    case Builtin::LE:
+    {
+        const ValueKind kind = numericResultKind(args, ValueKind::INT, LeOp::error, error);
+        return kind == ValueKind::NONE ? kind : ValueKind::INT;
+    }
+    case Builtin::HEAD:
+        return requireList(args[0], ValueKind::UNKNOWN, headError, error);
+    case Builtin::TAIL:
+        return requireList(args[0], ValueKind::LIST, tailError, error);
+    case Builtin::IF:
+        return joinKinds(args[1], args[2]);
+    case Builtin::ADD:
+        return numericResultKind(args, ValueKind::INT, AddOp::error, error);
+    case Builtin::SUB:
+        return numericResultKind(args, ValueKind::INT, SubOp::error, error);
+    case Builtin::MUL:
+        return numericResultKind(args, ValueKind::INT, MulOp::error, error);
+    case Builtin::DIV:
+        return numericResultKind(args, ValueKind::INT, DivOp::error, error);
+    case Builtin::POW:
+        // A negative integer exponent gives a real.
+        return numericResultKind(args, ValueKind::UNKNOWN, PowOp::error, error);
+    case Builtin::SQRT:
+        return requireNumber(args[0], ValueKind::REAL, sqrtError, error);
+    case Builtin::SIN:
+        return requireNumber(args[0], ValueKind::REAL, sinError, error);
+    case Builtin::COS:
+        return requireNumber(args[0], ValueKind::REAL, cosError, error);
+    case Builtin::MAP:
+        return requireList(args[1], ValueKind::LIST, mapError, error);
+    case Builtin::FILTER:
+        return requireList(args[1], ValueKind::LIST, filterError, error);
+    case Builtin::RANGE:
+        if (args[0] == ValueKind::REAL || args[0] == ValueKind::LIST || args[1] == ValueKind::REAL || args[1] == ValueKind::LIST) {
+            error = rangeError;
+            return ValueKind::NONE;
+        }
+        return ValueKind::LIST;
+    case Builtin::ITERATE:
+        if (args[0] == ValueKind::LIST || args[1] == ValueKind::LIST) {
+            error = iterateError;
+            return ValueKind::NONE;
+        }
+        return ValueKind::LIST;
+    case Builtin::TAKE:
+        if (args[0] == ValueKind::REAL || args[0] == ValueKind::LIST) {
+            error = takeCountError;
+            return ValueKind::NONE;
+        }
+        return requireList(args[1], ValueKind::LIST, takeListError, error);
+    case Builtin::APPEND:
+        return requireList(args[0], ValueKind::LIST, appendError, error);
+    default:
+        return ValueKind::UNKNOWN;
+    }
+}
+
+template<class Op>
+StrictBuiltinFunc uncheckedNumeric(const ValueKind* args) {
+    if (!isNumericKind(args[0]) || !isNumericKind(args[1])) {
+        return nullptr;
+    }
+    return args[0] == ValueKind::INT && args[1] == ValueKind::INT ? uncheckedIntFunc<Op> : uncheckedRealFunc<Op>;
+}
+
+StrictBuiltinFunc uncheckedBuiltin(Builtin id, const ValueKind* args) {
+    switch (id) {
+    case Builtin::LE:
+        return uncheckedNumeric<LeOp>(args);
+    case Builtin::ADD:
+        return uncheckedNumeric<AddOp>(args);
+    case Builtin::SUB:
+        return uncheckedNumeric<SubOp>(args);
+    case Builtin::MUL:
+        return uncheckedNumeric<MulOp>(args);
+    case Builtin::DIV:
+        return uncheckedNumeric<DivOp>(args);
+    case Builtin::POW:
+        return uncheckedNumeric<PowOp>(args);
+    default:
+        return nullptr;
+    }
+}
+
+void GlobalScope::loadDefaultLibrary() {
+    for (const BuiltinInfo &info : builtinTable) {
+        addFunction(makeBuiltinDefinition(info));
+    }
+}
\ No newline at end of file
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "ref.hpp"
+#include "returnValue.hpp"
+
+struct FunctionScope;
+struct FunctionDefinition;
+
+enum class Builtin : size_t {
+    EQ,
+    LE,
+    NAND,
+    LENGTH,
+    HEAD,
+    TAIL,
+    IF,
+    ADD,
+    SUB,
+    MUL,
+    DIV,
+    SQRT,
+    MAP,
+    FILTER,
+    SIN,
+    COS,
+    POW,
+    RANGE,
+    ITERATE,
+    TAKE,
+    APPEND,
+
+    COUNT,
+};
+
+// Strict builtins receive their operands already evaluated, in order.
+// Lazy builtins get the call scope and decide themselves what to force;
+// `forced` marks the arguments they always force regardless (bit i for #i).
+using StrictBuiltinFunc = Ref<Value>(*)(const Ref<Value>* args);
+using LazyBuiltinFunc = Ref<Value>(*)(FunctionScope& fncScp);
+
+struct BuiltinInfo {
+    Builtin id;
+    const char* name;
+    size_t argc;
+    uint64_t forced;
+    // Which of `strict` and `lazy` implements the builtin; the other is null.
+    bool isLazy;
+    StrictBuiltinFunc strict;
+    LazyBuiltinFunc lazy;
+};
+
+constexpr size_t builtinCount = static_cast<size_t>(Builtin::COUNT);
+constexpr size_t maxBuiltinArgc = 3;
+
+// What type inference (see typeInference.hpp) knows about a value. INT
+// covers both integer representations and LIST covers sequences; NONE is
+// the kind of an expression that never yields a value.
+enum class ValueKind : uint8_t {
+    NONE,
+    INT,
+    REAL,
+    LIST,
+    UNKNOWN,
+};
+
+// Raised by head() and tail() of anything but a list.
+constexpr const char* headError = "Typing error: the argument to head() must be a list!";
+constexpr const char* tailError = "Typing error: the argument to tail() must be a list!";
+
+// The least kind that covers both.
+constexpr ValueKind joinKinds(ValueKind fst, ValueKind snd) {
+    if (fst == snd || snd == ValueKind::NONE) {
+        return fst;
+    }
+    return fst == ValueKind::NONE ? snd : ValueKind::UNKNOWN;
+}
+
+const BuiltinInfo& builtinInfo(Builtin id);
+const BuiltinInfo* findBuiltin(const std::string& name, size_t argc);
+Ref<FunctionDefinition> makeBuiltinDefinition(const BuiltinInfo& info);
+
+Ref<Value> callBuiltin(Builtin id, FunctionScope& fncScp);
+
+// The kind of what builtin `id` returns for arguments of kinds `args`. If
+// the call is certain to fail, the result is NONE and `error` is set to
+// the message it would fail with.
+ValueKind builtinResultKind(Builtin id, const ValueKind* args, const char*& error);
+
+// An implementation of strict builtin `id` without the type checks, valid
+// only for arguments of kinds `args`; null if there is none for them.
+StrictBuiltinFunc uncheckedBuiltin(Builtin id, const ValueKind* args);
+
+// Numeric helpers shared with other value kinds. toBigInt() requires an
+// integer and toDouble() any number.
+bool isInteger(const Value& val);
+bool isNumber(const Value& val);
+BigInt toBigInt(const Value& val);
+double toDouble(const Value& val);
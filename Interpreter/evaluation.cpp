@@ -0,0 +1,89 @@
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+#ifdef __linux__
+#include <pthread.h>
+#endif
+
+#include "evaluation.hpp"
+
+EvalContext::EvalContext(const EvalBudget& budget)
+: budget(budget), slice(timeSlice()), nextYield(slice.interval), depthLimit(budget.maxDepth ? budget.maxDepth : std::numeric_limits<size_t>::max()),
+  memoryLimit(budget.maxMemory ? static_cast<int64_t>(budget.maxMemory) : std::numeric_limits<int64_t>::max()) {
+    if (budget.timeLimit.count() > 0) {
+        deadline = std::chrono::steady_clock::now() + budget.timeLimit;
+    }
+    const uintptr_t low = slice.stackLow ? slice.stackLow : threadStackLow();
+    stackLimit = low ? low + stackReserve : 0;
+    scheduleNextCheck();
+}
+
+uintptr_t EvalContext::threadStackLow() {
+    thread_local uintptr_t low = 0;
+    thread_local bool known = false;
+
+#ifdef __linux__
+    if (!known) {
+        pthread_attr_t attr;
+        if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+            void *addr;
+            size_t size;
+            if (pthread_attr_getstack(&attr, &addr, &size) == 0) {
+                low = reinterpret_cast<uintptr_t>(addr);
+            }
+            pthread_attr_destroy(&attr);
+        }
+    }
+#endif
+    known = true;
+    return low;
+}
+
+void EvalContext::scheduleNextCheck() {
+    const bool polled = budget.timeLimit.count() > 0 || budget.cancelFlag;
+
+    nextCheck = polled ? reductions + checkInterval : std::numeric_limits<uint64_t>::max();
+    if (slice.yield) {
+        nextCheck = std::min(nextCheck, nextYield);
+    }
+    if (budget.maxReductions) {
+        nextCheck = std::min(nextCheck, budget.maxReductions + 1);
+    }
+}
+
+void EvalContext::checkCall() {
+    if (reinterpret_cast<uintptr_t>(__builtin_frame_address(0)) < stackLimit) {
+        throw std::runtime_error("Evaluation ran out of native stack at depth " + std::to_string(depth));
+    }
+    if (depth >= depthLimit) {
+        throw std::runtime_error("Evaluation exceeded its recursion depth budget (maxDepth=" + std::to_string(budget.maxDepth) + ")");
+    }
+    checkBudget();
+}
+
+void EvalContext::checkBudget() {
+    if (budget.maxReductions && reductions > budget.maxReductions) {
+        throw std::runtime_error("Evaluation exceeded its reduction budget (maxReductions=" + std::to_string(budget.maxReductions) + ")");
+    }
+    if (budget.cancelFlag && budget.cancelFlag->load(std::memory_order_relaxed)) {
+        throw std::runtime_error("Evaluation cancelled after " + std::to_string(reductions) + " reductions");
+    }
+    if (budget.timeLimit.count() > 0 && std::chrono::steady_clock::now() >= deadline) {
+        throw std::runtime_error("Evaluation exceeded its time budget (timeLimit=" + std::to_string(budget.timeLimit.count()) + "ms)");
+    }
+
+    if (reductions >= nextCheck) {
+        if (slice.yield && reductions >= nextYield) {
+            nextYield = reductions + slice.interval;
+            slice.yield();
+        }
+        scheduleNextCheck();
+    }
+}
+
+
+void EvalContext::throwMemoryExceeded() const {
+    throw std::runtime_error("Evaluation exceeded its memory budget (maxMemory=" + std::to_string(budget.maxMemory) + " bytes)");
+}
\ No newline at end of file
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Default recursion limit for sessions, so runaway recursion ends in an
+// error well before the native stack (checked separately) runs out.
+constexpr size_t defaultMaxDepth = 20000;
+
+// Limits for one top-level evaluation. Zero means unlimited.
+struct EvalBudget {
+    uint64_t maxReductions = 0;
+    std::chrono::milliseconds timeLimit{0};
+    size_t maxDepth = 0;
+    // Bytes of values and nodes the evaluation may keep alive at once.
+    size_t maxMemory = 0;
+    // Another thread may set this to abort the evaluation at the next check.
+    const std::atomic<bool>* cancelFlag = nullptr;
+};
+
+// How evaluations started on this thread share it with others. The
+// scheduler (see scheduler.hpp) sets this while one of its fibers runs: an
+// evaluation then calls yield() every `interval` reductions, and checks the
+// native stack against the fiber's stack rather than the thread's.
+struct TimeSlice {
+    void (*yield)() = nullptr;
+    uint64_t interval = 0;
+    // Lowest usable address of the fiber's stack.
+    uintptr_t stackLow = 0;
+};
+
+// Per-evaluation bookkeeping. The context of the evaluation running on this
+// thread is reachable through current(); every user or builtin function call
+// goes through enterCall()/leaveCall().
+class EvalContext {
+public:
+    explicit EvalContext(const EvalBudget& budget);
+
+    static EvalContext*& current() {
+        thread_local EvalContext* context = nullptr;
+        return context;
+    }
+
+    static TimeSlice& timeSlice() {
+        thread_local TimeSlice slice;
+        return slice;
+    }
+
+    void enterCall() {
+        if (++reductions >= nextCheck || depth >= depthLimit ||
+            reinterpret_cast<uintptr_t>(__builtin_frame_address(0)) < stackLimit) {
+            checkCall();
+        }
+        ++depth;
+    }
+
+    // Throws if the evaluation ran out of reductions or time or was
+    // cancelled. Calls check this on their own every checkInterval
+    // reductions; loops that run long without making calls go through
+    // chargeWork() instead.
+    void checkBudget();
+
+    // Accounts `steps` units of work done without calls, such as limb
+    // operations of big integer arithmetic or elements printed, and checks
+    // the budget once every workCheckInterval of them.
+    void chargeWork(uint64_t steps) {
+        work += steps;
+        if (work >= workCheckInterval) {
+            work = 0;
+            checkBudget();
+        }
+    }
+
+    void leaveCall() {
+        --depth;
+    }
+
+    // Called for every accounted allocation and release on this thread, see
+    // memory.hpp. Usage is the net growth since the evaluation started, so it
+    // goes down when older values are freed.
+    void chargeMemory(size_t bytes) {
+        memoryUsed += bytes;
+        if (memoryUsed > peakMemory) {
+            if (memoryUsed > memoryLimit) {
+                memoryUsed -= bytes;
+                throwMemoryExceeded();
+            }
+            peakMemory = memoryUsed;
+        }
+    }
+
+    void releaseMemory(size_t bytes) {
+        memoryUsed -= bytes;
+    }
+
+    uint64_t getReductions() const { return reductions; }
+    int64_t getPeakMemory() const { return peakMemory; }
+
+private:
+    // How many reductions may pass between two looks at the clock and the
+    // cancel flag.
+    static constexpr uint64_t checkInterval = 1024;
+    static constexpr uint64_t workCheckInterval = 1 << 16;
+    // Native stack kept free below the deepest call, for the frames between
+    // two calls and for unwinding.
+    static constexpr uintptr_t stackReserve = 256 * 1024;
+
+    // Lowest usable address of this thread's stack, or 0 if unknown.
+    static uintptr_t threadStackLow();
+
+    void checkCall();
+    void scheduleNextCheck();
+    [[noreturn]] void throwMemoryExceeded() const;
+
+    EvalBudget budget;
+    TimeSlice slice;
+    std::chrono::steady_clock::time_point deadline;
+    uint64_t reductions = 0;
+    uint64_t nextCheck;
+    uint64_t nextYield;
+    uint64_t work = 0;
+    size_t depth = 0;
+    size_t depthLimit;
+    // The depth limit counts calls, but frames differ in size, so the stack
+    // itself is checked as well.
+    uintptr_t stackLimit;
+    int64_t memoryUsed = 0;
+    int64_t peakMemory = 0;
+    int64_t memoryLimit;
+};
+
+// chargeWork() on the current context, if there is one.
+inline void chargeEvalWork(uint64_t steps) {
+    if (EvalContext* context = EvalContext::current()) {
+        context->chargeWork(steps);
+    }
+}
+
+// Makes `context` the current one for as long as the guard lives.
+class EvalContextGuard {
+public:
+    explicit EvalContextGuard(EvalContext& context) : previous(EvalContext::current()) {
+        EvalContext::current() = &context;
+    }
+
+    ~EvalContextGuard() {
+        EvalContext::current() = previous;
+    }
+
+    EvalContextGuard(const EvalContextGuard&) = delete;
+    EvalContextGuard& operator=(const EvalContextGuard&) = delete;
+
+private:
+    EvalContext* previous;
+};
+
+// Accounts one call against the current context, if there is one.
+class CallGuard {
+public:
+    CallGuard() : context(EvalContext::current()) {
+        if (context) {
+            context->enterCall();
+        }
+    }
+
+    ~CallGuard() {
+        if (context) {
+            context->leaveCall();
+        }
+    }
+
+    CallGuard(const CallGuard&) = delete;
+    CallGuard& operator=(const CallGuard&) = delete;
+
+private:
+    EvalContext* context;
+};
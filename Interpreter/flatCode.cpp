@@ -0,0 +1,340 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include "evaluation.hpp"
+#include "flatCode.hpp"
+#include "parser.hpp"
+#include "strictness.hpp"
+#include "typeInference.hpp"
+#include "valueTable.hpp"
+
+Ref<FlatCode> FlatCode::compile(const Ref<Node>& body) {
+    Ref<FlatCode> code = makeRef<FlatCode>();
+    std::vector<const Node*> order = {body.get()};
+
+    for (size_t idx = 0; idx < order.size(); ++idx) {
+        const Node *node = order[idx];
+        code->childBegin.push_back(static_cast<uint32_t>(order.size()));
+
+        switch (node->kind) {
+        case Node::Kind::INT:
+        {
+            errno = 0;
+            const long long value = std::strtoll(node->token.data.c_str(), nullptr, 10);
+            if (errno == ERANGE) {
+                code->ops.push_back(Op::BIG_INT);
+                code->operands.push_back(code->literals.size());
+                code->literals.push_back(node->token.data);
+            }
+            else {
+                code->ops.push_back(Op::INT);
+                code->operands.push_back(value);
+            }
+            break;
+        }
+        case Node::Kind::DOUBLE:
+        {
+            const double value = std::stod(node->token.data);
+            int64_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            code->ops.push_back(Op::REAL);
+            code->operands.push_back(bits);
+            break;
+        }
+        case Node::Kind::ARGUMENT:
+            code->ops.push_back(Op::ARGUMENT);
+            code->operands.push_back(std::stoi(node->token.data));
+            break;
+        case Node::Kind::LIST_LITERAL:
+            code->ops.push_back(Op::LIST);
+            code->operands.push_back(0);
+            for (const Ref<Node> &item : node->as<ListLiteralNode>()->contents) {
+                order.push_back(item.get());
+            }
+            break;
+        case Node::Kind::FUNCTION_APPLICATION:
+        {
+            const std::vector<Ref<Node>> &args = node->as<FunctionApplication>()->arguments;
+            code->ops.push_back(Op::CALL);
+            code->operands.push_back(code->callees.size());
+            code->callees.push_back(FunctionKey(node->token.data, args.size()));
+            for (const Ref<Node> &arg : args) {
+                order.push_back(arg.get());
+            }
+            break;
+        }
+        default:
+            return nullptr;
+        }
+    }
+    code->childBegin.push_back(static_cast<uint32_t>(order.size()));
+    code->targets.resize(code->callees.size());
+    return code;
+}
+
+// Children come after their parent, so walking the nodes backwards has the
+// kinds of all arguments ready when a call is reached.
+void FlatCode::bindCalls(const GlobalScope& globalScope) {
+    std::vector<ValueKind> kinds(ops.size(), ValueKind::UNKNOWN);
+
+    for (uint32_t idx = ops.size(); idx-- > 0;) {
+        switch (ops[idx]) {
+        case Op::INT:
+        case Op::BIG_INT:
+            kinds[idx] = ValueKind::INT;
+            break;
+        case Op::REAL:
+            kinds[idx] = ValueKind::REAL;
+            break;
+        case Op::LIST:
+            kinds[idx] = ValueKind::LIST;
+            break;
+        case Op::CALL:
+        case Op::BUILTIN:
+        {
+            const FunctionKey &callee = callees[operands[idx]];
+            const ValueKind *args = kinds.data() + childBegin[idx];
+            const char *error;
+            kinds[idx] = callResultKind(callee, args, globalScope, {}, error);
+
+            CallTarget &target = targets[operands[idx]];
+            target.definition = globalScope.findDefinition(callee.first, callee.second);
+            const DefaultFunctionNode *node = target.definition ? target.definition->definition->as<DefaultFunctionNode>() : nullptr;
+            const BuiltinInfo *info = node ? &builtinInfo(node->id) : nullptr;
+
+            target.strict = nullptr;
+            if (info && !info->isLazy) {
+                const StrictBuiltinFunc unchecked = uncheckedBuiltin(info->id, args);
+                target.strict = unchecked ? unchecked : info->strict;
+            }
+            ops[idx] = target.strict ? Op::BUILTIN : Op::CALL;
+            break;
+        }
+        default:
+            break;
+        }
+    }
+}
+
+bool FlatCode::isBoundIn(const GlobalScope& globalScope) const {
+    for (size_t i = 0; i < callees.size(); ++i) {
+        if (globalScope.findDefinition(callees[i].first, callees[i].second) != targets[i].definition) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// A read may move the argument if the parameter is never read where a
+// callee decides when and how often to evaluate it, and no read of it can
+// come later. Nodes are visited in reverse evaluation order, collecting in
+// `readLater` the parameters that are still going to be read.
+void FlatCode::markLastUses(const GlobalScope& globalScope) {
+    std::vector<bool> lazyReads, readLater;
+    findLazyReads(0, false, globalScope, lazyReads);
+    markReads(0, globalScope, lazyReads, readLater);
+}
+
+uint64_t FlatCode::eagerArguments(uint32_t idx, const GlobalScope& globalScope, bool& isIf) const {
+    const FunctionKey &callee = callees[operands[idx]];
+    const FunctionDefinition *def = globalScope.findDefinition(callee.first, callee.second);
+    if (!def) {
+        isIf = false;
+        return 0;
+    }
+
+    const DefaultFunctionNode *builtin = def->definition->as<DefaultFunctionNode>();
+    isIf = builtin && builtin->id == Builtin::IF;
+    return isIf ? 0b111 : def->strictArguments;
+}
+
+void FlatCode::findLazyReads(uint32_t idx, bool lazy, const GlobalScope& globalScope, std::vector<bool>& lazyReads) const {
+    switch (ops[idx]) {
+    case Op::ARGUMENT:
+    case Op::MOVE_ARGUMENT:
+        if (lazy) {
+            const size_t param = operands[idx];
+            lazyReads.resize(std::max(lazyReads.size(), param + 1));
+            lazyReads[param] = true;
+        }
+        break;
+    case Op::LIST:
+        for (uint32_t child = childBegin[idx]; child < childBegin[idx + 1]; ++child) {
+            findLazyReads(child, lazy, globalScope, lazyReads);
+        }
+        break;
+    case Op::CALL:
+    case Op::BUILTIN:
+    {
+        bool isIf;
+        const uint64_t eager = eagerArguments(idx, globalScope, isIf);
+        for (uint32_t i = 0; i < childCount(idx); ++i) {
+            const bool eagerChild = i < maxStrictArguments && ((eager >> i) & 1);
+            findLazyReads(childBegin[idx] + i, lazy || !eagerChild, globalScope, lazyReads);
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+void FlatCode::markReads(uint32_t idx, const GlobalScope& globalScope, const std::vector<bool>& lazyReads, std::vector<bool>& readLater) {
+    switch (ops[idx]) {
+    case Op::ARGUMENT:
+    case Op::MOVE_ARGUMENT:
+    {
+        const size_t param = operands[idx];
+        const bool last = !(param < lazyReads.size() && lazyReads[param]) &&
+                          !(param < readLater.size() && readLater[param]);
+        ops[idx] = last ? Op::MOVE_ARGUMENT : Op::ARGUMENT;
+        readLater.resize(std::max(readLater.size(), param + 1));
+        readLater[param] = true;
+        break;
+    }
+    case Op::LIST:
+    case Op::CALL:
+    case Op::BUILTIN:
+    {
+        bool isIf = false;
+        if (ops[idx] != Op::LIST) {
+            eagerArguments(idx, globalScope, isIf);
+        }
+
+        if (isIf) {
+            const uint32_t cond = childBegin[idx];
+            std::vector<bool> otherBranch = readLater;
+            markReads(cond + 1, globalScope, lazyReads, readLater);
+            markReads(cond + 2, globalScope, lazyReads, otherBranch);
+
+            readLater.resize(std::max(readLater.size(), otherBranch.size()));
+            for (size_t param = 0; param < otherBranch.size(); ++param) {
+                readLater[param] = readLater[param] || otherBranch[param];
+            }
+            markReads(cond, globalScope, lazyReads, readLater);
+        }
+        else {
+            // Strict arguments are evaluated in order; reads in the others
+            // are never moved, so where they fall does not matter.
+            for (uint32_t child = childBegin[idx + 1]; child-- > childBegin[idx];) {
+                markReads(child, globalScope, lazyReads, readLater);
+            }
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+Ref<Value> FlatCode::evalOperand(uint32_t idx, FunctionScope& scope) const {
+    switch (ops[idx]) {
+    case Op::INT:
+        return makeInt(operands[idx]);
+    case Op::REAL:
+    {
+        double value;
+        std::memcpy(&value, &operands[idx], sizeof(value));
+        return makeReal(value);
+    }
+    case Op::BIG_INT:
+        return makeInteger(BigInt(literals[operands[idx]]));
+    case Op::ARGUMENT:
+        return scope.nth(operands[idx]);
+    case Op::MOVE_ARGUMENT:
+        return scope.take(operands[idx]);
+    case Op::LIST:
+        return list(idx, scope);
+    case Op::CALL:
+        return call(idx, scope);
+    case Op::BUILTIN:
+        return builtin(idx, scope);
+    }
+    throw std::runtime_error("Invalid flat code");
+}
+
+Ref<Value> FlatCode::list(uint32_t idx, FunctionScope& scope) const {
+    std::vector<Ref<Value>> values;
+    values.reserve(childCount(idx));
+    for (uint32_t child = childBegin[idx]; child < childBegin[idx + 1]; ++child) {
+        values.push_back(eval(child, scope));
+    }
+    return makeList(values);
+}
+
+// Same protocol as FunctionApplication::eval(), with the arguments being the
+// consecutive children of the call node.
+Ref<Value> FlatCode::call(uint32_t idx, FunctionScope& parentScope) const {
+    CallGuard guard;
+    GlobalScope &globalScope = parentScope.getGlobalScope();
+    const FunctionKey &callee = callees[operands[idx]];
+    const FunctionDefinition *def = targets[operands[idx]].definition;
+    if (!def) {
+        def = globalScope.findDefinition(callee.first, callee.second);
+        if (!def) {
+            throw std::runtime_error("Called function which is not defined");
+        }
+    }
+
+    const uint32_t first = childBegin[idx];
+    const size_t argc = callee.second;
+
+    if (def->strictArguments == 0) {
+        FunctionScope localScope(globalScope, parentScope, *this, first, argc, nullptr);
+        return globalScope.callFunction(*def, localScope);
+    }
+
+    Ref<Value> inlineValues[FunctionApplication::maxInlineArguments];
+    std::vector<Ref<Value>> values;
+    Ref<Value> *forced = inlineValues;
+    if (argc > FunctionApplication::maxInlineArguments) {
+        values.resize(argc);
+        forced = values.data();
+    }
+
+    const size_t generation = globalScope.getGeneration();
+    for (size_t i = 0; i < argc; ++i) {
+        if (def->isStrictIn(i)) {
+            forced[i] = eval(first + i, parentScope);
+        }
+    }
+
+    if (globalScope.getGeneration() != generation) {
+        def = globalScope.findDefinition(callee.first, callee.second);
+        if (!def) {
+            throw std::runtime_error("Called function which is not defined");
+        }
+    }
+
+    FunctionScope localScope(globalScope, parentScope, *this, first, argc, forced);
+    return globalScope.callFunction(*def, localScope);
+}
+
+// A call bound to a strict builtin: its arguments are all evaluated here and
+// handed straight to the implementation.
+Ref<Value> FlatCode::builtin(uint32_t idx, FunctionScope& parentScope) const {
+    CallGuard guard;
+    GlobalScope &globalScope = parentScope.getGlobalScope();
+    const uint32_t first = childBegin[idx];
+    const size_t argc = childCount(idx);
+
+    Ref<Value> args[maxBuiltinArgc];
+    const size_t generation = globalScope.getGeneration();
+    for (size_t i = 0; i < argc; ++i) {
+        args[i] = eval(first + i, parentScope);
+    }
+
+    // An argument may have defined a function that replaced the builtin.
+    if (globalScope.getGeneration() != generation) {
+        const FunctionKey &callee = callees[operands[idx]];
+        const FunctionDefinition *def = globalScope.findDefinition(callee.first, callee.second);
+        if (!def) {
+            throw std::runtime_error("Called function which is not defined");
+        }
+        FunctionScope localScope(globalScope, parentScope, *this, first, argc, args);
+        return globalScope.callFunction(*def, localScope);
+    }
+    return targets[operands[idx]].strict(args);
+}
\ No newline at end of file
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "builtins.hpp"
+#include "interpreter.hpp"
+#include "memory.hpp"
+#include "ref.hpp"
+
+// Executable function bodies are flattened unless this is 0 at build time,
+// in which case they are evaluated as node trees.
+#ifndef THISFUNC_FLAT_AST
+#define THISFUNC_FLAT_AST 1
+#endif
+
+struct Node;
+
+// A function body as parallel arrays, evaluated without chasing pointers
+// between heap-allocated nodes. Nodes are numbered breadth-first from the
+// root at 0, which puts the children of every node at consecutive indices:
+// node i has the children childBegin[i] up to childBegin[i + 1]. Names and
+// digits live in side tables that are only read by calls and big literals.
+struct FlatCode : public SharedRefCounted, public TrackedAllocation<MemoryKind::NODE> {
+    enum class Op : uint8_t {
+        INT,       // operand: the value
+        REAL,      // operand: the bits of the double
+        BIG_INT,   // operand: index into `literals`
+        ARGUMENT,  // operand: the parameter index
+        MOVE_ARGUMENT,  // the same, for the last read of that parameter
+        LIST,
+        CALL,      // operand: index into `callees`
+        BUILTIN,   // the same, for a call bound to a strict builtin
+    };
+
+    // What a call was bound to by bindCalls(): the definition it reaches,
+    // and for a strict builtin the implementation to run, unchecked if the
+    // argument kinds allow it.
+    struct CallTarget {
+        const FunctionDefinition* definition = nullptr;
+        StrictBuiltinFunc strict = nullptr;
+    };
+
+    std::vector<Op> ops;
+    std::vector<int64_t> operands;
+    std::vector<uint32_t> childBegin;
+
+    std::vector<FunctionKey> callees;
+    std::vector<CallTarget> targets;
+    std::vector<std::string> literals;
+
+    // Null if `body` contains nodes only the tree evaluator knows, such as
+    // nested definitions or builtin bodies.
+    static Ref<FlatCode> compile(const Ref<Node>& body);
+
+    // Turns every read of a parameter that no other read can follow into a
+    // MOVE_ARGUMENT, given the strictness masks of the callees. Stale marks
+    // only cost time: an argument read again after its move is evaluated
+    // once more by the caller.
+    void markLastUses(const GlobalScope& globalScope);
+
+    // Resolves every call once, so that evaluating it needs no lookup, and
+    // binds calls of strict builtins straight to their implementation. Must
+    // be redone whenever a callee is redefined or changes its kind; a call
+    // whose callee is not defined is still looked up each time.
+    void bindCalls(const GlobalScope& globalScope);
+    // Whether every call is bound to what it reaches in `globalScope`, so
+    // that the code can run there as it is.
+    bool isBoundIn(const GlobalScope& globalScope) const;
+
+    // Calls are dispatched here, so a deep recursion only stacks frames of
+    // call() and not of the switch over the other nodes.
+    Ref<Value> eval(uint32_t idx, FunctionScope& scope) const {
+        if (ops[idx] == Op::CALL) {
+            return call(idx, scope);
+        }
+        return ops[idx] == Op::BUILTIN ? builtin(idx, scope) : evalOperand(idx, scope);
+    }
+
+    bool isList(uint32_t idx) const { return ops[idx] == Op::LIST; }
+    uint32_t firstChild(uint32_t idx) const { return childBegin[idx]; }
+    uint32_t childCount(uint32_t idx) const { return childBegin[idx + 1] - childBegin[idx]; }
+
+private:
+    // Which arguments of call `idx` are evaluated right away, at most once
+    // and in order. if() evaluates its condition and then one branch.
+    uint64_t eagerArguments(uint32_t idx, const GlobalScope& globalScope, bool& isIf) const;
+    void findLazyReads(uint32_t idx, bool lazy, const GlobalScope& globalScope, std::vector<bool>& lazyReads) const;
+    void markReads(uint32_t idx, const GlobalScope& globalScope, const std::vector<bool>& lazyReads, std::vector<bool>& readLater);
+
+    Ref<Value> evalOperand(uint32_t idx, FunctionScope& scope) const;
+    Ref<Value> list(uint32_t idx, FunctionScope& scope) const;
+    Ref<Value> call(uint32_t idx, FunctionScope& scope) const;
+    Ref<Value> builtin(uint32_t idx, FunctionScope& scope) const;
+};
\ No newline at end of file
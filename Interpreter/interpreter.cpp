@@ -2,463 +2,457 @@
 #include <stdexcept>
 #include <algorithm>
 
+#include "evaluation.hpp"
+#include "flatCode.hpp"
 #include "interpreter.hpp"
+#include "optimizer.hpp"
 #include "parser.hpp"
+#include "strictness.hpp"
+#include "typeInference.hpp"
+#include "valueTable.hpp"
 
-bool GlobalScope::isFunctionDefined(const std::string& name, size_t argc) {
-    return definitions.find(name) != definitions.end() && definitions[name].find(argc) != definitions[name].end();
+bool GlobalScope::isFunctionDefined(const std::string& name, size_t argc) const {
+    return findDefinition(name, argc) != nullptr;
 }
 
-std::shared_ptr<Value> GlobalScope::callFunction(const std::string& name, FunctionScope& fncScp) {
-    if (!isFunctionDefined(name, fncScp.paramCount())) {
-        throw std::runtime_error("Called function which is not defined");
+const FunctionDefinition* GlobalScope::findDefinition(const std::string& name, size_t argc) const {
+    const auto byName = definitions.find(name);
+    if (byName != definitions.end()) {
+        const auto byArgc = byName->second.find(argc);
+        if (byArgc != byName->second.end()) {
+            return byArgc->second.get();
+        }
     }
-
-    return definitions[name][fncScp.paramCount()]->definition->eval(fncScp);
-}
-
-bool GlobalScope::addFunction(std::shared_ptr<FunctionDefinition> definition) {
-    size_t argc = definition->getArgc();
-    bool isDefinded = isFunctionDefined(definition->token.data, argc);
-
-	definitions[definition->token.data][argc] = definition;
-	return isDefinded;
+    return library ? library->findDefinition(name, argc) : nullptr;
 }
 
-std::shared_ptr<Value> FunctionScope::nth(size_t idx) const {
-    if (idx >= parameters.size()) {
-        throw std::runtime_error("Index out of range");
+Ref<Value> GlobalScope::callFunction(const FunctionDefinition& def, FunctionScope& fncScp) {
+    if (def.code) {
+        return def.code->eval(0, fncScp);
     }
-
-    return parameters[idx]->eval(*parentScope);
+    return def.definition->eval(fncScp);
 }
 
-std::shared_ptr<Value> FunctionScope::headOfList() const{
-    if (parameters.empty()) {
-        throw std::runtime_error("head() with no parameters given");
-    }
-
-    std::shared_ptr<ListLiteralNode> l = std::dynamic_pointer_cast<ListLiteralNode>(parameters[0]);
+bool GlobalScope::addFunction(Ref<FunctionDefinition> definition) {
+    const FunctionKey key(definition->token.data, definition->getArgc());
+    bool isDefinded = isFunctionDefined(key.first, key.second);
 
-    if (l) {
-        return l->contents[0]->eval(*parentScope);
+    // A definition that is sure to fail is rejected before it replaces
+    // anything.
+    try {
+        checkTypes(definition->definition, key, *this);
+    } catch (const std::runtime_error &typeError) {
+        rejected[key] = definition;
+        throw std::runtime_error("In the definition of " + key.first + ": " + typeError.what());
     }
+    rejected.erase(key);
 
-    const std::shared_ptr<Value> fst = parameters[0]->eval(*parentScope);
-
-    if (fst->type == Value::Type::LIST_LITERAL) {
-		const std::shared_ptr<ListLiteralValue> lst = std::dynamic_pointer_cast<ListLiteralValue>(fst);
-
-        if (!lst->values.empty()) {
-            return lst->values.front();
-        }
-        throw std::runtime_error("Empty list head call"); 
+    ++generation;
+    sources[key] = definition;
+    updateDependencies(key);
+    dropSpecializations(key);
+    optimizeFunction(key);
+    invalidateDependents(key);
+    updateStrictness(key);
+    if (observer) {
+        observer->definitionChanged(key);
     }
-	throw std::runtime_error("Typing error: the argument to head() must be a list!");
+
+	return isDefinded;
 }
 
-std::shared_ptr<Value> FunctionScope::tailOfList() const {
-    if (parameters.empty()) {
-        throw std::runtime_error("tail() with no parameters given");
+bool GlobalScope::removeFunction(const FunctionKey& key) {
+    const bool wasRejected = rejected.erase(key) != 0;
+    if (sources.erase(key) == 0) {
+        return wasRejected;
     }
+    ++generation;
 
-    std::shared_ptr<ListLiteralNode> l = std::dynamic_pointer_cast<ListLiteralNode>(parameters[0]);
-    if (l) {
-        std::vector<std::shared_ptr<Value>> newVals;
-        for (size_t i = 1; i < l->contents.size(); ++i) {
-            newVals.push_back(l->contents[i]->eval(*parentScope));
-        }
+    definitions[key.first].erase(key.second);
+    updateDependencies(key);
+    inlinedCallees.erase(key);
+    dropSpecializations(key);
 
-        return std::dynamic_pointer_cast<Value>(std::make_shared<ListLiteralValue>(newVals));
+    const BuiltinInfo *builtin = library ? nullptr : findBuiltin(key.first, key.second);
+    if (builtin) {
+        addFunction(makeBuiltinDefinition(*builtin));
+        return true;
     }
 
-    const std::shared_ptr<Value> fst = parameters[0]->eval(*parentScope);
+    invalidateDependents(key);
+    updateStrictness(key);
+    if (observer) {
+        observer->definitionChanged(key);
+    }
+    return true;
+}
 
-    if (fst->type == Value::Type::LIST_LITERAL) {
-		std::vector<std::shared_ptr<Value>> &vals = std::dynamic_pointer_cast<ListLiteralValue>(fst)->values;
-        std::vector<std::shared_ptr<Value>> newVals;
-        for (size_t i = 1; i < vals.size(); ++i) {
-            newVals.push_back(vals[i]);
+// One accepted definition can change the kinds another one was rejected
+// for, so passes repeat until one accepts nothing.
+std::vector<FunctionKey> GlobalScope::retryRejected() {
+    std::vector<FunctionKey> accepted;
+
+    for (bool progress = true; progress;) {
+        progress = false;
+        const std::map<FunctionKey, Ref<FunctionDefinition>> pending = rejected;
+        for (const auto &entry : pending) {
+            try {
+                addFunction(entry.second);
+                accepted.push_back(entry.first);
+                progress = true;
+            } catch (const std::runtime_error &) {
+                // Still rejected; addFunction() kept it.
+            }
         }
-
-        return std::dynamic_pointer_cast<Value>(std::make_shared<ListLiteralValue>(newVals));
     }
-	throw std::runtime_error("Typing error: the argument to tail() must be a list!");
+    return accepted;
 }
 
-bool eqDouble(double fst, double snd) {
-    return std::abs(fst - snd) < (1.0/(1<<30));
+Ref<FunctionDefinition> GlobalScope::findSource(const std::string& name, size_t argc) const {
+    const auto it = sources.find(FunctionKey(name, argc));
+    if (it != sources.end()) {
+        return it->second;
+    }
+    return library ? library->findSource(name, argc) : nullptr;
 }
 
-bool eqHelper(const std::shared_ptr<Value> fst, const std::shared_ptr<Value> snd) {
-    if (fst->type == Value::Type::LIST_LITERAL && fst->type == snd->type) {
-        std::vector<std::shared_ptr<Value>> &fstVals = std::dynamic_pointer_cast<ListLiteralValue>(fst)->values;
-        std::vector<std::shared_ptr<Value>> &sndVals = std::dynamic_pointer_cast<ListLiteralValue>(snd)->values;
+std::set<FunctionKey> GlobalScope::dependentsOf(const FunctionKey& key) const {
+    std::set<FunctionKey> dependents;
+    std::vector<FunctionKey> pending = {key};
 
-        if (fstVals.size() != sndVals.size()) {
-            return false;
-        }
+    while (!pending.empty()) {
+        const FunctionKey current = pending.back();
+        pending.pop_back();
 
-        for (size_t i = 0; i < fstVals.size(); ++i) {
-            if (!eqHelper(fstVals[i], sndVals[i])) {
-                return false;
+        std::set<FunctionKey> direct;
+        collectCallers(current, direct);
+        for (const FunctionKey &caller : direct) {
+            if (dependents.insert(caller).second) {
+                pending.push_back(caller);
             }
         }
-        return true;
     }
-    else if (fst->type == Value::Type::INT_NUMBER && fst->type == snd->type) {
-        return (std::dynamic_pointer_cast<IntValue>(fst)->value == std::dynamic_pointer_cast<IntValue>(snd)->value);
-    }
-    else if (fst->type == Value::Type::REAL_NUMBER && fst->type == snd->type) {
-        return eqDouble(std::dynamic_pointer_cast<RealValue>(fst)->value, std::dynamic_pointer_cast<RealValue>(snd)->value);
-    }
-    else if (fst->type == Value::Type::LIST_LITERAL) {
-        std::vector<std::shared_ptr<Value>> &fstVals = std::dynamic_pointer_cast<ListLiteralValue>(fst)->values;
-        if (fstVals.size() != 1) {
-            return false;
-        }
-        return eqHelper(fstVals[0], snd);
+    dependents.erase(key);
+    return dependents;
 }
-    else if (snd->type == Value::Type::LIST_LITERAL) {
-        std::vector<std::shared_ptr<Value>> &sndVals = std::dynamic_pointer_cast<ListLiteralValue>(snd)->values;
-        
-        if (sndVals.size() != 1) {
-            return false;
-        }
 
-        return eqHelper(fst, sndVals[0]);
-    }
-    
-    double f, s;
-    if (fst->type == Value::Type::REAL_NUMBER && snd->type == Value::Type::INT_NUMBER) {
-        f = std::dynamic_pointer_cast<RealValue>(fst)->value;
-        s = std::dynamic_pointer_cast<IntValue>(snd)->value;
-
-        return eqDouble(f, s);
-    }
-    else if (fst->type == Value::Type::INT_NUMBER && snd->type == Value::Type::REAL_NUMBER) {
-        f = std::dynamic_pointer_cast<IntValue>(fst)->value;
-        s = std::dynamic_pointer_cast<RealValue>(snd)->value;
+const Specialization* GlobalScope::findSpecialization(const FunctionKey& key) const {
+    const auto it = specializations.find(key);
+    return it != specializations.end() ? &it->second : nullptr;
+}
 
-        return eqDouble(f, s);
+void GlobalScope::addSpecialization(const FunctionKey& key, const Specialization& specialization) {
+    specializations[key] = specialization;
+    if (specialization.definition) {
+#if THISFUNC_FLAT_AST
+        specialization.definition->code = FlatCode::compile(specialization.definition->definition);
+#endif
+        definitions[key.first][key.second] = specialization.definition;
     }
-    return false;
 }
 
-std::shared_ptr<Value> eqFunc(FunctionScope &fncScp) {
-    const std::shared_ptr<Value> fst = fncScp.nth(0);
-    const std::shared_ptr<Value> snd = fncScp.nth(1);
-
-    return std::dynamic_pointer_cast<Value>(std::make_shared<IntValue>(eqHelper(fst, snd)));
+void GlobalScope::removeSpecialization(const FunctionKey& key) {
+    ++generation;
+    specializations.erase(key);
+    definitions[key.first].erase(key.second);
 }
 
-std::shared_ptr<Value> leFunc(FunctionScope &fncScp) {
-    const std::shared_ptr<Value> fst = fncScp.nth(0);
-    const std::shared_ptr<Value> snd = fncScp.nth(1);
-
-    if (fst->type == snd->type) {
-        switch (fst->type) {
-		case Value::Type::INT_NUMBER:
-        {
-			int fstVal = std::dynamic_pointer_cast<IntValue>(fst)->value;
-			int sndVal = std::dynamic_pointer_cast<IntValue>(snd)->value;
-			
-			return std::dynamic_pointer_cast<Value>(std::make_shared<IntValue>(fstVal < sndVal));
-		}
-		case Value::Type::REAL_NUMBER:
-		{
-			double fstVal = std::dynamic_pointer_cast<RealValue>(fst)->value;
-			double sndVal = std::dynamic_pointer_cast<RealValue>(snd)->value;
-			
-			return std::dynamic_pointer_cast<Value>(std::make_shared<IntValue>(fstVal < sndVal));
-		}
-		case Value::Type::LIST_LITERAL:
-			throw std::runtime_error("List comparison not supported");
-		default:
-			throw std::runtime_error("Unknown type comparison");
+// Callers of a dropped clone also used everything it uses, so they are
+// rebuilt by invalidateDependents() and make fresh clones.
+void GlobalScope::dropSpecializations(const FunctionKey& key) {
+    std::vector<FunctionKey> stale;
+    for (const auto &entry : specializations) {
+        if (entry.second.uses.count(key)) {
+            stale.push_back(entry.first);
         }
     }
-
-    throw std::runtime_error("Diffrent types comparison");
-}
-
-std::shared_ptr<Value> nandFunc(FunctionScope &fncScp) {
-	bool res;
-
-	for (size_t i = 0; i < 2; ++i) {
-        std::shared_ptr<Value> val = fncScp.nth(i);
-		switch (val->type) {
-		case Value::Type::INT_NUMBER:
-		{
-			res = std::dynamic_pointer_cast<IntValue>(val)->value;
-		}
-			break;
-		case Value::Type::REAL_NUMBER:
-		{
-			res = std::dynamic_pointer_cast<RealValue>(val)->value;
-		}
-			break;
-		case Value::Type::LIST_LITERAL:
-		{
-			res = !std::dynamic_pointer_cast<ListLiteralValue>(val)->values.empty();
-		}
-			break;
-		default:
-			throw std::runtime_error("Cannot nand() unknown types!");
-        }
-        if (!res) {
-            return std::dynamic_pointer_cast<Value>(std::make_shared<IntValue>(1));
-        }
-	}
-	return std::dynamic_pointer_cast<Value>(std::make_shared<IntValue>(0));
-}
-
-std::shared_ptr<Value> lengthFunc(FunctionScope &fncScp) {
-    const std::shared_ptr<Value> fst = fncScp.nth(0);
-
-    if (fst->type != Value::Type::LIST_LITERAL) {
-		return std::dynamic_pointer_cast<Value>(std::make_shared<IntValue>(-1));
+    for (const FunctionKey &spec : stale) {
+        removeSpecialization(spec);
     }
-
-    return std::dynamic_pointer_cast<Value>(std::make_shared<IntValue>(int(std::dynamic_pointer_cast<ListLiteralValue>(fst)->values.size())));
 }
 
-std::shared_ptr<Value> headFunc(FunctionScope &fncScp) {
-    return fncScp.headOfList();
+void GlobalScope::collectCallers(const FunctionKey& key, std::set<FunctionKey>& out) const {
+    const auto it = callers.find(key);
+    if (it != callers.end()) {
+        out.insert(it->second.begin(), it->second.end());
+    }
+    if (library) {
+        library->collectCallers(key, out);
+    }
 }
 
-std::shared_ptr<Value> tailFunc(FunctionScope &fncScp) {
-    return fncScp.tailOfList();
+bool GlobalScope::hasInlined(const FunctionKey& caller, const FunctionKey& callee) const {
+    const auto it = inlinedCallees.find(caller);
+    return it != inlinedCallees.end() && it->second.count(callee) != 0;
 }
 
-std::shared_ptr<Value> mapFunc(FunctionScope &fncScp) {
-    const std::shared_ptr<Value> func = fncScp.nth(0);
-    const std::shared_ptr<Value> list = fncScp.nth(1);
+void GlobalScope::updateDependencies(const FunctionKey& key) {
+    for (const FunctionKey &callee : callees[key]) {
+        callers[callee].erase(key);
+    }
 
-    if (list->type != Value::Type::LIST_LITERAL) {
-        throw std::runtime_error("Typing error: the second argument to map() must be a list!");
+    std::set<FunctionKey> calls;
+    const auto it = sources.find(key);
+    if (it != sources.end()) {
+        collectCalls(it->second->definition, calls);
     }
-    
-    const std::vector<std::shared_ptr<Value>> &listVals = std::dynamic_pointer_cast<ListLiteralValue>(list)->values;
-    std::vector<std::shared_ptr<Value>> newVals;
-    
-    for (const auto &val : listVals) {  
-        newVals.push_back(val);
+
+    for (const FunctionKey &callee : calls) {
+        callers[callee].insert(key);
     }
-    return std::make_shared<ListLiteralValue>(newVals);
+    callees[key] = calls;
 }
 
-std::shared_ptr<Value> filterFunc(FunctionScope &fncScp) {
-    const std::shared_ptr<Value> func = fncScp.nth(0);
-    const std::shared_ptr<Value> list = fncScp.nth(1);
-
-    if (list->type != Value::Type::LIST_LITERAL) {
-        throw std::runtime_error("Typing error: the second argument to filter() must be a list!");
-    }
-    
-    const std::vector<std::shared_ptr<Value>> &listVals = std::dynamic_pointer_cast<ListLiteralValue>(list)->values;
-    std::vector<std::shared_ptr<Value>> newVals;
-    
-    for (const auto &val : listVals) {  
-        newVals.push_back(val);
+// Only artifacts derived from `key` are rebuilt: direct callers may now be
+// able to inline it, and anything that already carries a copy of it is stale.
+void GlobalScope::invalidateDependents(const FunctionKey& key) {
+    for (const FunctionKey &dependent : dependentsOf(key)) {
+        if (sources.count(dependent)) {
+            if (callees[dependent].count(key) || hasInlined(dependent, key)) {
+                optimizeFunction(dependent);
+            }
+        }
+        else if (library && library->hasInlined(dependent, key)) {
+            // The shared library copy is stale for this session only, so the
+            // session gets its own copy that sees the new definition.
+            sources[dependent] = library->findSource(dependent.first, dependent.second);
+            updateDependencies(dependent);
+            optimizeFunction(dependent);
+        }
     }
-
-    return std::make_shared<ListLiteralValue>(newVals);
 }
 
-std::shared_ptr<Value> ifFunc(FunctionScope &fncScp) {
-    const std::shared_ptr<Value> fst = fncScp.nth(0);
-    bool condition;
+void GlobalScope::optimizeFunction(const FunctionKey& key) {
+    const Ref<FunctionDefinition> source = sources[key];
 
-    if (fst->type == Value::Type::INT_NUMBER) {
-        condition = std::dynamic_pointer_cast<IntValue>(fst)->value;
-    }
-    else if (fst->type == Value::Type::REAL_NUMBER) {
-        condition = std::dynamic_pointer_cast<RealValue>(fst)->value;
-    }
-    else if (fst->type == Value::Type::LIST_LITERAL) {
-        condition = !std::dynamic_pointer_cast<ListLiteralValue>(fst)->values.empty();
-    }
-    else {
-        throw std::runtime_error("Typing error: the condition of if must be a number - int, real or list literal!");
-    }
+    std::vector<FunctionKey> expanding = {key};
+    std::set<FunctionKey> inlined;
+    const Ref<Node> body = specializeCalls(inlineCalls(source->definition, expanding, *this, inlined), *this, inlined);
 
-    return fncScp.nth(condition ? 1 : 2);
-}
+    // Always a fresh node: the source may be shared with other sessions,
+    // while the strictness mask of the executable copy is rewritten in place.
+    Ref<FunctionDefinition> executable = makeRef<FunctionDefinition>(source->token, body);
+    executable->strictArguments = source->strictArguments;
+#if THISFUNC_FLAT_AST
+    executable->code = FlatCode::compile(body);
+#endif
 
-std::shared_ptr<Value> addFunc(FunctionScope &fncScp) {
-    std::shared_ptr<Value> vals[2] = {fncScp.nth(0), fncScp.nth(1)};
-    double res = 0;
-    bool isDouble = false;
+    inlinedCallees[key] = inlined;
+    definitions[key.first][key.second] = executable;
+}
 
-    for (size_t i = 0; i < 2; ++i) {
-        if (vals[i]->type == Value::Type::REAL_NUMBER) {
-            res += std::dynamic_pointer_cast<RealValue>(vals[i])->value;
-            isDouble = true;
-        }
-        else if (vals[i]->type == Value::Type::INT_NUMBER) {
-            res += std::dynamic_pointer_cast<IntValue>(vals[i])->value;
+// Masks of `key` and of everything that calls it are recomputed together:
+// they start out strict in every argument and are weakened until nothing
+// changes, which gives the most precise masks even through mutual recursion.
+// A library function whose shared mask is too strict for what this session
+// defined, or whose calls are bound to definitions this session replaced,
+// gets a session-local copy, and the round is repeated with it.
+void GlobalScope::updateStrictness(const FunctionKey& key) {
+    bool copied = true;
+
+    while (copied) {
+        std::set<FunctionKey> affected = dependentsOf(key);
+        affected.insert(key);
+        // Clones are cheap to include and may call any of the above.
+        for (const auto &spec : specializations) {
+            if (spec.second.definition) {
+                affected.insert(spec.first);
+            }
         }
-        else {
-            throw std::runtime_error("The arguments to add() must be numbers");
+
+        std::map<FunctionKey, uint64_t> assumed;
+        for (const FunctionKey &fn : affected) {
+            const FunctionDefinition *def = findDefinition(fn.first, fn.second);
+            if (def && !def->definition->as<DefaultFunctionNode>()) {
+                assumed[fn] = allArguments(fn.second);
+            }
         }
-    }
 
-    if (isDouble) {
-        return std::dynamic_pointer_cast<Value>(std::make_shared<RealValue>(res));
-    }
-    return std::dynamic_pointer_cast<Value>(std::make_shared<IntValue>(trunc(res)));
-}
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (auto &entry : assumed) {
+                const FunctionDefinition *def = findDefinition(entry.first.first, entry.first.second);
+                const uint64_t mask = entry.second & forcedArguments(def->definition, *this, assumed);
+
+                if (mask != entry.second) {
+                    entry.second = mask;
+                    changed = true;
+                }
+            }
+        }
 
-std::shared_ptr<Value> subFunc(FunctionScope &fncScp) {
-    std::shared_ptr<Value> vals[2] = {fncScp.nth(0), fncScp.nth(1)};
-    double res = 0;
-    bool isDouble = false;
+        copied = false;
+        for (const auto &entry : assumed) {
+            const FunctionKey &fn = entry.first;
+            const FunctionDefinition *def = findDefinition(fn.first, fn.second);
 
-    for (int i = 0; i < 2; ++i) {
-        if (vals[i]->type == Value::Type::REAL_NUMBER) {
-            res += (std::dynamic_pointer_cast<RealValue>(vals[i])->value * (1 - 2 * i));
-            isDouble = true;
+            if (sources.count(fn) || specializations.count(fn)) {
+                definitions[fn.first][fn.second]->strictArguments = entry.second;
+            }
+            else if ((def->strictArguments & ~entry.second) != 0 || (def->code && !def->code->isBoundIn(*this))) {
+                sources[fn] = library->findSource(fn.first, fn.second);
+                updateDependencies(fn);
+                optimizeFunction(fn);
+                copied = true;
+            }
         }
-        else if (vals[i]->type == Value::Type::INT_NUMBER) {
-            res += (std::dynamic_pointer_cast<IntValue>(vals[i])->value * (1 - 2 * i));
+        if (copied) {
+            continue;
         }
-        else {
-            throw std::runtime_error("The arguments to sub() must be numbers");
+
+        // Which reads are the last ones depends on the masks of the callees.
+        for (const auto &entry : assumed) {
+            const FunctionKey &fn = entry.first;
+            if (sources.count(fn) || specializations.count(fn)) {
+                const Ref<FunctionDefinition> &def = definitions[fn.first][fn.second];
+                if (def->code) {
+                    def->code->markLastUses(*this);
+                }
+            }
         }
+        updateTypes(affected);
     }
+}
 
-    if (isDouble) {
-        return std::dynamic_pointer_cast<Value>(std::make_shared<RealValue>(res));
+// Kinds start out as NONE and are widened until nothing changes. Calls are
+// bound once all of them are known, since a call may be bound to an
+// unchecked builtin because of the kind of another function.
+void GlobalScope::updateTypes(const std::set<FunctionKey>& affected) {
+    std::map<FunctionKey, ValueKind> assumed;
+    for (const FunctionKey &fn : affected) {
+        const FunctionDefinition *def = findDefinition(fn.first, fn.second);
+        if (def && !def->definition->as<DefaultFunctionNode>()) {
+            assumed[fn] = ValueKind::NONE;
+        }
     }
-    return std::dynamic_pointer_cast<Value>(std::make_shared<IntValue>(trunc(res)));
-}
 
-std::shared_ptr<Value> mulFunc(FunctionScope &fncScp) {
-    std::shared_ptr<Value> vals[2] = {fncScp.nth(0), fncScp.nth(1)};
-    double res = 1.0;
-    bool isDouble = false;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (auto &entry : assumed) {
+            const FunctionDefinition *def = findDefinition(entry.first.first, entry.first.second);
+            const ValueKind kind = joinKinds(entry.second, resultKind(def->definition, *this, assumed));
 
-    for (size_t i = 0; i < 2; ++i) {
-        if (vals[i]->type == Value::Type::REAL_NUMBER) {
-            res *= std::dynamic_pointer_cast<RealValue>(vals[i])->value;
-            isDouble = true;
-        }
-        else if (vals[i]->type == Value::Type::INT_NUMBER) {
-            res *= std::dynamic_pointer_cast<IntValue>(vals[i])->value;
-        }
-        else {
-            throw std::runtime_error("The arguments to mul() must be numbers");
+            if (kind != entry.second) {
+                entry.second = kind;
+                changed = true;
+            }
         }
     }
 
-    if (isDouble) {
-        return std::dynamic_pointer_cast<Value>(std::make_shared<RealValue>(res));
+    for (const auto &entry : assumed) {
+        const FunctionKey &fn = entry.first;
+        if (sources.count(fn) || specializations.count(fn)) {
+            definitions[fn.first][fn.second]->resultKind = entry.second;
+        }
+    }
+    for (const auto &entry : assumed) {
+        const FunctionKey &fn = entry.first;
+        if (sources.count(fn) || specializations.count(fn)) {
+            const Ref<FunctionDefinition> &def = definitions[fn.first][fn.second];
+            if (def->code) {
+                def->code->bindCalls(*this);
+            }
+        }
     }
-    return std::dynamic_pointer_cast<Value>(std::make_shared<IntValue>(trunc(res)));
 }
 
-std::shared_ptr<Value> divFunc(FunctionScope &fncScp) {
-    const std::shared_ptr<Value> fst = fncScp.nth(0);
-    const std::shared_ptr<Value> snd = fncScp.nth(1);
-
-    if ((fst->type != Value::Type::REAL_NUMBER && fst->type != Value::Type::INT_NUMBER) ||
-        (snd->type != Value::Type::REAL_NUMBER && snd->type != Value::Type::INT_NUMBER)) {
-        throw std::runtime_error("The arguments to div() must be numbers");
+Ref<Value> FunctionScope::nth(size_t idx) const {
+    if (idx >= parameterCount) {
+        throw std::runtime_error("Index out of range");
     }
 
-    double fstVal = (fst->type == Value::Type::REAL_NUMBER) 
-        ? std::dynamic_pointer_cast<RealValue>(fst)->value 
-        : std::dynamic_pointer_cast<IntValue>(fst)->value;
-
-    double sndVal = (snd->type == Value::Type::REAL_NUMBER) 
-        ? std::dynamic_pointer_cast<RealValue>(snd)->value 
-        : std::dynamic_pointer_cast<IntValue>(snd)->value;
-
-    if (sndVal == 0.0) {
-        throw std::runtime_error("Division by zero!");
+    if (!isDeferred(idx)) {
+        return arguments[idx];
     }
-
-    double result = fstVal / sndVal;
-    if (fst->type == Value::Type::REAL_NUMBER || snd->type == Value::Type::REAL_NUMBER) {
-        return std::make_shared<RealValue>(result);
-    } else {
-        return std::make_shared<IntValue>(static_cast<int>(result));
+    if (code) {
+        return code->eval(firstArgument + idx, *parentScope);
     }
+    return parameters[idx]->eval(*parentScope);
 }
 
-std::shared_ptr<Value> sqrtFunc(FunctionScope &fncScp) {
-    const std::shared_ptr<Value>& fst = fncScp.nth(0);
-
-    if (fst->type == Value::Type::INT_NUMBER) {
-        return std::dynamic_pointer_cast<Value>(std::make_shared<RealValue>(std::sqrt((double)std::dynamic_pointer_cast<IntValue>(fst)->value)));
+Ref<Value> FunctionScope::take(size_t idx) {
+    if (ownedArguments && idx < parameterCount && ownedArguments[idx]) {
+        return std::move(ownedArguments[idx]);
     }
-    else if (fst->type == Value::Type::REAL_NUMBER) {
-        return std::dynamic_pointer_cast<Value>(std::make_shared<RealValue>(std::sqrt(std::dynamic_pointer_cast<RealValue>(fst)->value)));
-    }
-    throw std::runtime_error("The argument to sqrt() must be a number");
+    return nth(idx);
 }
 
-std::shared_ptr<Value> sinFunc(FunctionScope &fncScp) {
-    const std::shared_ptr<Value>& fst = fncScp.nth(0);
+Ref<Value> FunctionScope::headOfList() const{
+    if (parameterCount == 0) {
+        throw std::runtime_error("head() with no parameters given");
+    }
 
-    if (fst->type == Value::Type::INT_NUMBER) {
-        return std::dynamic_pointer_cast<Value>(std::make_shared<RealValue>(std::sin((double)std::dynamic_pointer_cast<IntValue>(fst)->value)));
+    if (isDeferred(0) && code) {
+        if (code->isList(firstArgument) && code->childCount(firstArgument) > 0) {
+            return code->eval(code->firstChild(firstArgument), *parentScope);
+        }
     }
-    else if (fst->type == Value::Type::REAL_NUMBER) {
-        return std::dynamic_pointer_cast<Value>(std::make_shared<RealValue>(std::sin(std::dynamic_pointer_cast<RealValue>(fst)->value)));
+    else if (isDeferred(0)) {
+        const ListLiteralNode* l = parameters[0]->as<ListLiteralNode>();
+        if (l && !l->contents.empty()) {
+            return l->contents[0]->eval(*parentScope);
+        }
     }
-    throw std::runtime_error("The argument to sin() must be a number");
-}
 
-std::shared_ptr<Value> cosFunc(FunctionScope &fncScp) {
-    const std::shared_ptr<Value>& fst = fncScp.nth(0);
+    const Ref<Value> fst = nth(0);
+
+    if (fst->type == Value::Type::LIST_LITERAL) {
+		const ListLiteralValue* lst = fst->as<ListLiteralValue>();
 
-    if (fst->type == Value::Type::INT_NUMBER) {
-        return std::dynamic_pointer_cast<Value>(std::make_shared<RealValue>(std::cos((double)std::dynamic_pointer_cast<IntValue>(fst)->value)));
+        if (!lst->values.empty()) {
+            return lst->values.front();
+        }
+        throw std::runtime_error("Empty list head call"); 
     }
-    else if (fst->type == Value::Type::REAL_NUMBER) {
-        return std::dynamic_pointer_cast<Value>(std::make_shared<RealValue>(std::cos(std::dynamic_pointer_cast<RealValue>(fst)->value)));
+    if (const SequenceValue* seq = fst->as<SequenceValue>()) {
+        if (!seq->isEmpty()) {
+            return seq->at(0);
+        }
+        throw std::runtime_error("Empty list head call");
     }
-    throw std::runtime_error("The argument to cos() must be a number");
+	throw std::runtime_error(headError);
 }
 
-std::shared_ptr<Value> powFunc(FunctionScope &fncScp) {
-    const std::shared_ptr<Value>& fst = fncScp.nth(0);
-    const std::shared_ptr<Value>& snd = fncScp.nth(1);
+Ref<Value> FunctionScope::tailOfList() const {
+    if (parameterCount == 0) {
+        throw std::runtime_error("tail() with no parameters given");
+    }
+
+    if (isDeferred(0) && code && code->isList(firstArgument)) {
+        std::vector<Ref<Value>> newVals;
+        const uint32_t first = code->firstChild(firstArgument);
+        for (uint32_t i = 1; i < code->childCount(firstArgument); ++i) {
+            newVals.push_back(code->eval(first + i, *parentScope));
+        }
 
-    if ((fst->type != Value::Type::REAL_NUMBER && fst->type != Value::Type::INT_NUMBER) ||
-        (snd->type != Value::Type::REAL_NUMBER && snd->type != Value::Type::INT_NUMBER)) {
-        throw std::runtime_error("The arguments to pow() must be numbers");
+        return makeList(newVals);
     }
 
-    double fstVal = (fst->type == Value::Type::REAL_NUMBER) 
-        ? std::dynamic_pointer_cast<RealValue>(fst)->value 
-        : std::dynamic_pointer_cast<IntValue>(fst)->value;
+    const ListLiteralNode* l = isDeferred(0) && !code ? parameters[0]->as<ListLiteralNode>() : nullptr;
+    if (l) {
+        std::vector<Ref<Value>> newVals;
+        for (size_t i = 1; i < l->contents.size(); ++i) {
+            newVals.push_back(l->contents[i]->eval(*parentScope));
+        }
+
+        return makeList(newVals);
+    }
 
-    double sndVal = (snd->type == Value::Type::REAL_NUMBER) 
-        ? std::dynamic_pointer_cast<RealValue>(snd)->value 
-        : std::dynamic_pointer_cast<IntValue>(snd)->value;
+    const Ref<Value> fst = nth(0);
 
-    return std::dynamic_pointer_cast<Value>(std::make_shared<RealValue>(std::pow(fstVal, sndVal)));
+    // A view of the remaining elements instead of a copy, so repeated tail()
+    // calls cost nothing per element.
+    if (fst->type == Value::Type::LIST_LITERAL) {
+		const size_t size = fst->as<ListLiteralValue>()->values.size();
+        if (size == 0) {
+            return fst;
+        }
+        return SequenceValue::window(fst, 1, size - 1);
+    }
+    if (const SequenceValue* seq = fst->as<SequenceValue>()) {
+        return seq->drop(1);
+    }
+	throw std::runtime_error(tailError);
 }
-
-void GlobalScope::loadDefaultLibrary() {
-    const std::function<std::shared_ptr<Value>(FunctionScope&)> functions[] = {
-        eqFunc, leFunc, nandFunc, lengthFunc, headFunc, tailFunc,
-        ifFunc, addFunc, subFunc, mulFunc, divFunc,
-        sqrtFunc, mapFunc, filterFunc, sinFunc, cosFunc, powFunc };
-    const std::string names[] = {
-        "eq", "le", "nand", "length", "head", "tail",
-        "if", "add", "sub", "mul", "div",
-        "sqrt", "map", "filter", "sin", "cos", "pow" };
-    const size_t arguments[] = {
-        2, 2, 2, 1, 1, 1, 
-        3, 2, 2, 2, 2,
-        1, 2, 2, 1, 1, 2 };
-    for (size_t i = 0; i < 18; ++i) {
-        Token tok = {Token::Type::FUNC, names[i], -1};
-        std::shared_ptr<FunctionDefinition> fDef = std::make_shared<FunctionDefinition>(tok, std::make_shared<DefaultFunctionNode>(names[i], functions[i], arguments[i]));
-        addFunction(fDef);
-    }
-}
\ No newline at end of file
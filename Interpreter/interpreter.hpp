@@ -1,46 +1,171 @@
 #pragma once
+#include <cstdint>
+#include <map>
+#include <set>
 #include <string>
 #include <unordered_map>
+#include <utility>
 #include <vector>
-#include <memory>
 
+#include "ref.hpp"
 #include "returnValue.hpp"
 
 struct Node;
 struct FunctionDefinition;
 struct FunctionScope;
+struct FlatCode;
+
+using FunctionKey = std::pair<std::string, size_t>;
+
+// A clone of a function specialized on some constant arguments, see
+// specializeCalls() in optimizer.hpp. Redefining anything in `uses` drops
+// it. The definition stays null while the clone is being built.
+struct Specialization {
+    Ref<FunctionDefinition> definition;
+    std::set<FunctionKey> uses;
+};
+
+// Told about every function that is defined, redefined or removed in a
+// scope, after the scope has updated its call graph.
+struct DefinitionObserver {
+    virtual void definitionChanged(const FunctionKey& key) = 0;
+
+protected:
+    ~DefinitionObserver() = default;
+};
 
 struct GlobalScope {
-    bool isFunctionDefined(const std::string& name, size_t argc);
-    std::shared_ptr<Value> callFunction(const std::string& name, FunctionScope& fncScp);
-    bool addFunction(std::shared_ptr<FunctionDefinition> definition);
+    GlobalScope() = default;
+
+    // A session scope layered over a shared library scope. Lookups that miss
+    // locally fall through to the library, which is only ever read, so many
+    // sessions on different threads can share one library.
+    explicit GlobalScope(const GlobalScope* library) : library(library) {}
+
+    GlobalScope(const GlobalScope&) = delete;
+    GlobalScope& operator=(const GlobalScope&) = delete;
+
+    // Bumped on every definition change, so callers holding on to a resolved
+    // definition know when to look it up again.
+    size_t getGeneration() const { return generation; }
+
+    bool isFunctionDefined(const std::string& name, size_t argc) const;
+    const FunctionDefinition* findDefinition(const std::string& name, size_t argc) const;
+    Ref<Value> callFunction(const FunctionDefinition& def, FunctionScope& fncScp);
+    // Throws if checkTypes() (see typeInference.hpp) rejects the definition.
+    // The previous definition then stays in effect.
+    bool addFunction(Ref<FunctionDefinition> definition);
+    bool removeFunction(const FunctionKey& key);
+    bool isRejected(const FunctionKey& key) const { return rejected.count(key) != 0; }
+    // Adds every rejected definition again, until no more of them pass, and
+    // returns the keys of those that did.
+    std::vector<FunctionKey> retryRejected();
     void loadDefaultLibrary();
 
+    Ref<FunctionDefinition> findSource(const std::string& name, size_t argc) const;
+
+    // Every function that calls `key`, directly or through other functions.
+    std::set<FunctionKey> dependentsOf(const FunctionKey& key) const;
+
+    // Specializations live next to the other executable definitions, under
+    // mangled names like "power{_,10}" that user code cannot spell. A
+    // session only reuses its own.
+    const Specialization* findSpecialization(const FunctionKey& key) const;
+    void addSpecialization(const FunctionKey& key, const Specialization& specialization);
+    void removeSpecialization(const FunctionKey& key);
+
+    // At most one observer; null detaches it.
+    void setObserver(DefinitionObserver* observer) { this->observer = observer; }
+
 private:
-    std::unordered_map<std::string, std::unordered_map<size_t, std::shared_ptr<FunctionDefinition>>> definitions;
+    void optimizeFunction(const FunctionKey& key);
+    void updateDependencies(const FunctionKey& key);
+    void invalidateDependents(const FunctionKey& key);
+    void updateStrictness(const FunctionKey& key);
+    void updateTypes(const std::set<FunctionKey>& affected);
+    void dropSpecializations(const FunctionKey& key);
+    void collectCallers(const FunctionKey& key, std::set<FunctionKey>& out) const;
+    bool hasInlined(const FunctionKey& caller, const FunctionKey& callee) const;
+
+    const GlobalScope* library = nullptr;
+    DefinitionObserver* observer = nullptr;
+    size_t generation = 0;
+
+    // Executable (optimized) definitions, looked up on every call.
+    std::unordered_map<std::string, std::unordered_map<size_t, Ref<FunctionDefinition>>> definitions;
+    // Definitions exactly as the user wrote them; optimization always restarts from these.
+    std::map<FunctionKey, Ref<FunctionDefinition>> sources;
+    // Call graph of the sources. Edges are kept for callees that are not
+    // defined yet, so defining them later still reaches their callers.
+    std::map<FunctionKey, std::set<FunctionKey>> callees;
+    std::map<FunctionKey, std::set<FunctionKey>> callers;
+    // Caller -> every function whose source was copied into its optimized body.
+    std::map<FunctionKey, std::set<FunctionKey>> inlinedCallees;
+    // Clones made by specializeCalls(); their executable definitions are
+    // also in `definitions`.
+    std::map<FunctionKey, Specialization> specializations;
+    // The latest definition of each function that checkTypes() rejected.
+    // Nothing retries them on its own, since a definition the user was told
+    // is wrong should not take effect behind their back: only --watch mode
+    // calls retryRejected(), as the script on disk still holds them and is
+    // entered again on every save.
+    std::map<FunctionKey, Ref<FunctionDefinition>> rejected;
 };
 
+// Scopes live on the C++ stack of the evaluation that created them and are
+// strictly nested, so a scope refers to its parent and to the arguments of
+// the call without owning either. Each argument is either a value computed
+// by the caller or an unevaluated node, forced in the parent scope on demand.
 struct FunctionScope {
-    FunctionScope(GlobalScope &globalExecContext, std::shared_ptr<FunctionScope> parentScope, const std::vector<std::shared_ptr<Node>> &parameters)
-    : globalExecContext(globalExecContext), parentScope(parentScope), parameters(parameters) {}
+    explicit FunctionScope(GlobalScope &globalExecContext)
+    : globalExecContext(globalExecContext), parentScope(nullptr), parameters(nullptr), arguments(nullptr), parameterCount(0) {}
 
-    FunctionScope(GlobalScope &globalExecContext, std::shared_ptr<FunctionScope> parentScope, std::vector<std::shared_ptr<Node>>&& parameters)
-    : globalExecContext(globalExecContext), parentScope(parentScope), parameters(std::move(parameters)) {}
+    FunctionScope(GlobalScope &globalExecContext, FunctionScope &parentScope, const std::vector<Ref<Node>> &parameters)
+    : globalExecContext(globalExecContext), parentScope(&parentScope), parameters(parameters.data()), arguments(nullptr), parameterCount(parameters.size()) {}
 
-    std::shared_ptr<Value> nth(size_t idx) const;
+    // `arguments[i]` holds the value of parameter i if the caller already
+    // evaluated it, or null if it is still deferred. The array belongs to the
+    // call, so take() may move values out of it.
+    FunctionScope(GlobalScope &globalExecContext, FunctionScope &parentScope, const std::vector<Ref<Node>> &parameters, Ref<Value>* arguments)
+    : globalExecContext(globalExecContext), parentScope(&parentScope), parameters(parameters.data()), arguments(arguments), parameterCount(parameters.size()), ownedArguments(arguments) {}
 
-    std::shared_ptr<Value> headOfList() const;
-    std::shared_ptr<Value> tailOfList() const;
+    // The same for a call in flattened code, whose arguments are the nodes
+    // firstArgument, firstArgument + 1, ... of `code`.
+    FunctionScope(GlobalScope &globalExecContext, FunctionScope &parentScope, const FlatCode &code, uint32_t firstArgument, size_t argumentCount, Ref<Value>* arguments)
+    : globalExecContext(globalExecContext), parentScope(&parentScope), parameters(nullptr), arguments(arguments), parameterCount(argumentCount), ownedArguments(arguments), code(&code), firstArgument(firstArgument) {}
 
-    size_t paramCount() const { return parameters.size(); }
+    FunctionScope(GlobalScope &globalExecContext, const Ref<Value>* arguments, size_t argumentCount)
+    : globalExecContext(globalExecContext), parentScope(nullptr), parameters(nullptr), arguments(arguments), parameterCount(argumentCount) {}
+
+    FunctionScope(const FunctionScope&) = delete;
+    FunctionScope& operator=(const FunctionScope&) = delete;
+
+    Ref<Value> nth(size_t idx) const;
+    // nth() for the last read of an argument: the value is moved out of the
+    // caller's array when the scope owns it, so that it may be the only
+    // reference left. A moved argument that is read again is deferred and
+    // evaluated once more.
+    Ref<Value> take(size_t idx);
+
+    Ref<Value> headOfList() const;
+    Ref<Value> tailOfList() const;
+
+    size_t paramCount() const { return parameterCount; }
 
     GlobalScope& getGlobalScope() { return globalExecContext; }
 
     const GlobalScope& getGlobalScope() const { return globalExecContext; }
 
 private:
+    bool isDeferred(size_t idx) const { return (parameters || code) && !(arguments && arguments[idx]); }
+
     GlobalScope& globalExecContext;
 
-    std::shared_ptr<FunctionScope> parentScope;
-    std::vector<std::shared_ptr<Node>> parameters;
+    FunctionScope* parentScope;
+    const Ref<Node>* parameters;
+    const Ref<Value>* arguments;
+    size_t parameterCount;
+    Ref<Value>* ownedArguments = nullptr;
+    const FlatCode* code = nullptr;
+    uint32_t firstArgument = 0;
 };
\ No newline at end of file
@@ -5,6 +5,22 @@ Lexer::Lexer(const std::string& input) : input(input) {}
 
 std::vector<Token> Lexer::lex() {
     std::vector<Token> tokens;
+    lex(input, tokens);
+    return tokens;
+}
+
+void Lexer::lex(const std::string& input, std::vector<Token>& tokens) {
+    size_t count = 0;
+    auto emit = [&](Token::Type type, size_t from, size_t to, int startIdx) {
+        if (count == tokens.size()) {
+            tokens.emplace_back();
+        }
+        Token &token = tokens[count++];
+        token.type = type;
+        token.data.assign(input, from, to - from);
+        token.startIdx = startIdx;
+    };
+
     int currentIdx = 0;
 
     while (currentIdx < input.length()) {
@@ -16,66 +32,59 @@ std::vector<Token> Lexer::lex() {
         }
         else if (next == ',') {
             ++currentIdx;
-            tokens.push_back({ Token::Type::COMMA, ",", tokenStartIdx });
+            emit(Token::Type::COMMA, tokenStartIdx, tokenStartIdx + 1, tokenStartIdx);
         }
         else if (next == '[') {
             ++currentIdx;
-            tokens.push_back({Token::Type::OPEN_SQUARE, "[", tokenStartIdx});
+            emit(Token::Type::OPEN_SQUARE, tokenStartIdx, tokenStartIdx + 1, tokenStartIdx);
         }
         else if (next == ']') {
             ++currentIdx;
-            tokens.push_back({Token::Type::CLOSE_SQUARE, "]", tokenStartIdx});
+            emit(Token::Type::CLOSE_SQUARE, tokenStartIdx, tokenStartIdx + 1, tokenStartIdx);
         }
         else if (next == '(') {
             ++currentIdx;
-            tokens.push_back({Token::Type::OPEN_ROUND, "(", tokenStartIdx});
+            emit(Token::Type::OPEN_ROUND, tokenStartIdx, tokenStartIdx + 1, tokenStartIdx);
         }
         else if (next == ')') {
             ++currentIdx;
-            tokens.push_back({Token::Type::CLOSE_ROUND, ")", tokenStartIdx});
+            emit(Token::Type::CLOSE_ROUND, tokenStartIdx, tokenStartIdx + 1, tokenStartIdx);
         }
         else if (next == '<' && currentIdx + 1 < input.length() && input[currentIdx + 1] == '-') {
             currentIdx += 2;
-            tokens.push_back({Token::Type::ARROW, "<-", tokenStartIdx});
+            emit(Token::Type::ARROW, tokenStartIdx, tokenStartIdx + 2, tokenStartIdx);
         }
         else if (next == '#') {
-            std::string word;
             ++currentIdx;
 
             while (currentIdx < input.length() && isdigit(input[currentIdx])) {
-                word += input[currentIdx];
                 ++currentIdx;
             }
 
-            tokens.push_back({Token::Type::ARG, word, tokenStartIdx});
+            emit(Token::Type::ARG, tokenStartIdx + 1, currentIdx, tokenStartIdx);
         }
-        else if (next == 'l' && input.substr(currentIdx, 4) == "list") {
+        else if (next == 'l' && input.compare(currentIdx, 4, "list") == 0) {
             currentIdx += 4;
-            tokens.push_back({Token::Type::KW_LIST, "list", tokenStartIdx});
+            emit(Token::Type::KW_LIST, tokenStartIdx, tokenStartIdx + 4, tokenStartIdx);
         }
         else if ((next >= '0' && next <= '9') || next == '-' || next == '+') {
-            std::string word;
             bool decimal = false, empty = true;
 
             if (next == '-' || next == '+') {
-                word += input[currentIdx];
                 ++currentIdx;
             }
 
             while (currentIdx < input.length() && isdigit(input[currentIdx])) {
                 empty = false;
-                word += input[currentIdx];
                 ++currentIdx;
             }
 
             if (currentIdx < input.length() && input[currentIdx] == '.') {
                 decimal = true;
-                word += input[currentIdx];
                 ++currentIdx;
             }
 
             while (currentIdx < input.length() && isdigit(input[currentIdx])) {
-                word += input[currentIdx];
                 ++currentIdx;
             }
 
@@ -84,26 +93,22 @@ std::vector<Token> Lexer::lex() {
             }
 
             if (decimal) {
-                tokens.push_back({Token::Type::KW_DOUBLE, word, tokenStartIdx});
+                emit(Token::Type::KW_DOUBLE, tokenStartIdx, currentIdx, tokenStartIdx);
             }
             else {
-                tokens.push_back({Token::Type::KW_INT, word, tokenStartIdx});
+                emit(Token::Type::KW_INT, tokenStartIdx, currentIdx, tokenStartIdx);
             }
         }
         else if (isalpha(next)) {
-            std::string word;
-            
             while (currentIdx < input.length() && (isalpha(input[currentIdx]) || isdigit(input[currentIdx]))) {
-                word += input[currentIdx];
                 ++currentIdx;
             }
 
-            tokens.push_back({Token::Type::FUNC, word, tokenStartIdx});
+            emit(Token::Type::FUNC, tokenStartIdx, currentIdx, tokenStartIdx);
         }
         else {
             throw std::runtime_error("Unknown character while generating tokens");
         }
     }
-    tokens.push_back({Token::Type::eof, "", currentIdx});
-    return tokens;
+    emit(Token::Type::eof, currentIdx, currentIdx, currentIdx);
 }
\ No newline at end of file
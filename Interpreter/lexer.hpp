@@ -8,6 +8,11 @@ public:
     Lexer(const std::string&);
     std::vector<Token> lex();
 
+    // Lexes `input` into `tokens`, overwriting the tokens already there so
+    // their strings keep their buffers from line to line. Parsing stops at the
+    // eof token, so anything left after it from a longer line is never read.
+    static void lex(const std::string& input, std::vector<Token>& tokens);
+
 private:
     std::string input;
 };
\ No newline at end of file
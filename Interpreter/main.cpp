@@ -1,16 +1,124 @@
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "server.hpp"
 #include "thisFuncSingleton.hpp"
 
+namespace {
+
+int usage(const char* program) {
+    std::cerr << "Usage: " << program << " [--max-reductions N] [--timeout-ms N] [--max-depth N] [--max-memory-mb N]\n"
+              << "       [--shards N] [--query-cache FILE] [--pipe] [script | --watch script | --serve socket [library]]\n";
+    return 1;
+}
+
+// A decimal number without a sign, at most `max`.
+bool parseCount(const char* text, uint64_t max, uint64_t& value) {
+    const char* end = text + std::strlen(text);
+    const std::from_chars_result result = std::from_chars(text, end, value);
+    return result.ec == std::errc() && result.ptr == end && value <= max;
+}
+
+}
+
 int main(int argc, const char** argv) {
 
+    EvalBudget budget = ListFunc::getInstance().getBudget();
+    std::vector<std::string> args;
+    size_t shards = 0;
+    bool piped = false;
+    std::string queryCachePath;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+
+        if ((arg == "--max-reductions" || arg == "--timeout-ms" || arg == "--max-depth" || arg == "--max-memory-mb") && i + 1 < argc) {
+            // Each limit must fit its field once converted: megabytes to
+            // bytes, and a deadline to clock ticks added to the current time.
+            const uint64_t max = arg == "--max-memory-mb" ? std::numeric_limits<size_t>::max() >> 20 :
+                                 arg == "--timeout-ms" ? uint64_t(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::duration::max()).count() / 2) :
+                                 arg == "--max-depth" ? std::numeric_limits<size_t>::max() :
+                                 std::numeric_limits<uint64_t>::max();
+            uint64_t limit;
+            if (!parseCount(argv[++i], max, limit)) {
+                std::cerr << "Invalid value for " << arg << ": " << argv[i] << '\n';
+                return usage(argv[0]);
+            }
+
+            if (arg == "--max-reductions") {
+                budget.maxReductions = limit;
+            }
+            else if (arg == "--timeout-ms") {
+                budget.timeLimit = std::chrono::milliseconds(limit);
+            }
+            else if (arg == "--max-depth") {
+                budget.maxDepth = limit;
+            }
+            else {
+                budget.maxMemory = limit << 20;
+            }
+        }
+        else if (arg == "--shards" && i + 1 < argc) {
+            uint64_t count;
+            if (!parseCount(argv[++i], std::numeric_limits<size_t>::max(), count)) {
+                std::cerr << "Invalid value for --shards: " << argv[i] << '\n';
+                return usage(argv[0]);
+            }
+            shards = count;
+        }
+        else if (arg == "--query-cache" && i + 1 < argc) {
+            queryCachePath = argv[++i];
+        }
+        else if (arg == "--pipe") {
+            piped = true;
+        }
+        else {
+            args.push_back(arg);
+        }
+    }
+    ListFunc::getInstance().setBudget(budget);
+    if (!queryCachePath.empty()) {
+        try {
+            ListFunc::getInstance().attachQueryCache(queryCachePath);
+        } catch (const std::runtime_error &cacheException) {
+            std::cerr << cacheException.what() << '\n';
+            return 1;
+        }
+    }
+
+    // Input from another program gets plain output that is easy to consume.
+    if (args.empty() && (piped || !isatty(STDIN_FILENO))) {
+        return ListFunc::getInstance().runPiped();
+    }
+
     std::cout << "\033[1m\033[36mWelcome to thisFunc's interpreter!\033[0m" << std::endl;
     std::cout << "\033[1m\033[34m              Made by Emil Peev\033[0m" << std::endl;
     std::cout << "\033[1m\033[36m---------------------------------\033[0m" << std::endl;
-    switch (argc) {
-    case 1:
+
+    const std::string mode = args.empty() ? "" : args[0];
+    if (mode == "--watch" && args.size() == 2) {
+        return ListFunc::getInstance().watch(args[1].c_str());
+    }
+    if (mode == "--serve" && (args.size() == 2 || args.size() == 3)) {
+        Server server(args[1], args.size() == 3 ? args[2].c_str() : nullptr, budget);
+        return server.serve();
+    }
+
+    switch (args.size()) {
+    case 0:
         return ListFunc::getInstance().run();
-    case 2:
-        return ListFunc::getInstance().run(argv[1]);
+    case 1:
+        return ListFunc::getInstance().run(args[0].c_str(), shards);
     default:
-        return -1;
+        return usage(argv[0]);
     }
 }
\ No newline at end of file
@@ -0,0 +1,166 @@
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#include "evaluation.hpp"
+#include "memory.hpp"
+
+namespace {
+
+// Counters of one thread. Only the owning thread writes them, so updates are
+// plain loads and stores; they are atomic only so that memoryStats() may read
+// them from another thread. Memory freed by a different thread than the one
+// that allocated it is subtracted there, which keeps the sums right.
+struct ThreadCounters {
+    struct Entry {
+        std::atomic<int64_t> liveBytes;
+        std::atomic<int64_t> liveObjects;
+        std::atomic<uint64_t> allocations;
+    };
+
+    Entry kinds[memoryKindCount];
+};
+
+template<class T>
+void bump(std::atomic<T>& counter, T delta) {
+    counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
+
+struct Registry {
+    std::mutex mutex;
+    std::vector<const ThreadCounters*> threads;
+    // What threads that already exited left behind.
+    MemoryStats retired;
+};
+
+// Never destroyed: values may still be released while other statics go away.
+Registry& registry() {
+    static Registry* instance = new Registry();
+    return *instance;
+}
+
+void addCounters(MemoryStats& stats, const ThreadCounters& counters) {
+    for (size_t i = 0; i < memoryKindCount; ++i) {
+        stats.kinds[i].liveBytes += counters.kinds[i].liveBytes.load(std::memory_order_relaxed);
+        stats.kinds[i].liveObjects += counters.kinds[i].liveObjects.load(std::memory_order_relaxed);
+        stats.kinds[i].allocations += counters.kinds[i].allocations.load(std::memory_order_relaxed);
+    }
+}
+
+// Trivially destructible, so the counters stay usable while other
+// thread-local objects, such as the value table, release their values.
+thread_local ThreadCounters counters;
+thread_local bool registered = false;
+
+struct Registration {
+    Registration() {
+        Registry& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        reg.threads.push_back(&counters);
+    }
+
+    ~Registration() {
+        Registry& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        addCounters(reg.retired, counters);
+        for (size_t i = 0; i < memoryKindCount; ++i) {
+            counters.kinds[i].liveBytes.store(0, std::memory_order_relaxed);
+            counters.kinds[i].liveObjects.store(0, std::memory_order_relaxed);
+            counters.kinds[i].allocations.store(0, std::memory_order_relaxed);
+        }
+        reg.threads.erase(std::find(reg.threads.begin(), reg.threads.end(), &counters));
+    }
+};
+
+ThreadCounters::Entry& localEntry(MemoryKind kind) {
+    if (!registered) {
+        registered = true;
+        thread_local Registration registration;
+    }
+    return counters.kinds[static_cast<size_t>(kind)];
+}
+
+void charge(size_t bytes, int64_t objects, MemoryKind kind) {
+    if (EvalContext* context = EvalContext::current()) {
+        context->chargeMemory(bytes);
+    }
+
+    ThreadCounters::Entry& entry = localEntry(kind);
+    bump<int64_t>(entry.liveBytes, bytes);
+    bump<int64_t>(entry.liveObjects, objects);
+    bump<uint64_t>(entry.allocations, 1);
+}
+
+void release(size_t bytes, int64_t objects, MemoryKind kind) noexcept {
+    if (EvalContext* context = EvalContext::current()) {
+        context->releaseMemory(bytes);
+    }
+
+    ThreadCounters::Entry& entry = localEntry(kind);
+    bump<int64_t>(entry.liveBytes, -static_cast<int64_t>(bytes));
+    bump<int64_t>(entry.liveObjects, -objects);
+}
+
+const char* const kindNames[memoryKindCount] = {"int", "real", "bigint", "list", "sequence", "node"};
+
+}
+
+MemoryStats::Entry MemoryStats::total() const {
+    Entry res;
+    for (const Entry& entry : kinds) {
+        res.liveBytes += entry.liveBytes;
+        res.liveObjects += entry.liveObjects;
+        res.allocations += entry.allocations;
+    }
+    return res;
+}
+
+std::string MemoryStats::toString() const {
+    const Entry sum = total();
+    std::string out = "live_bytes=" + std::to_string(sum.liveBytes) +
+                      " live_objects=" + std::to_string(sum.liveObjects) +
+                      " allocations=" + std::to_string(sum.allocations);
+
+    for (size_t i = 0; i < memoryKindCount; ++i) {
+        out += ' ';
+        out += kindNames[i];
+        out += '=' + std::to_string(kinds[i].liveBytes) + '/' + std::to_string(kinds[i].liveObjects);
+    }
+    return out;
+}
+
+MemoryStats memoryStats() {
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+
+    MemoryStats res = reg.retired;
+    for (const ThreadCounters* thread : reg.threads) {
+        addCounters(res, *thread);
+    }
+    return res;
+}
+
+void* allocateTracked(size_t bytes, MemoryKind kind) {
+    charge(bytes, 1, kind);
+    try {
+        return ::operator new(bytes);
+    } catch (...) {
+        release(bytes, 1, kind);
+        throw;
+    }
+}
+
+void releaseTracked(void* ptr, size_t bytes, MemoryKind kind) noexcept {
+    ::operator delete(ptr);
+    release(bytes, 1, kind);
+}
+
+void chargeBuffer(size_t bytes, MemoryKind kind) {
+    charge(bytes, 0, kind);
+}
+
+void releaseBuffer(size_t bytes, MemoryKind kind) noexcept {
+    release(bytes, 0, kind);
+}
\ No newline at end of file
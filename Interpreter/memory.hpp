@@ -0,0 +1,62 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// What an accounted allocation belongs to: one kind per value type, and one
+// for all AST nodes.
+enum class MemoryKind {
+    INT,
+    REAL,
+    BIG_INT,
+    LIST,
+    SEQUENCE,
+    NODE,
+    COUNT,
+};
+
+constexpr size_t memoryKindCount = static_cast<size_t>(MemoryKind::COUNT);
+
+struct MemoryStats {
+    struct Entry {
+        int64_t liveBytes = 0;
+        int64_t liveObjects = 0;
+        uint64_t allocations = 0;
+    };
+
+    std::array<Entry, memoryKindCount> kinds;
+
+    Entry total() const;
+
+    // One line of key=value pairs; every kind is listed as bytes/objects.
+    std::string toString() const;
+};
+
+// Process-wide totals, summed over every thread that ever allocated.
+MemoryStats memoryStats();
+
+// Objects are charged with their full size and count as one live object.
+// Buffers an object owns (list elements, bignum limbs) are charged to its
+// kind as bytes only. Charging throws std::runtime_error when it would take
+// the evaluation running on this thread over its memory budget.
+void* allocateTracked(size_t bytes, MemoryKind kind);
+void releaseTracked(void* ptr, size_t bytes, MemoryKind kind) noexcept;
+void chargeBuffer(size_t bytes, MemoryKind kind);
+void releaseBuffer(size_t bytes, MemoryKind kind) noexcept;
+
+// Routes `new` and `delete` of a class and everything derived from it
+// through the accounting above. Deleting through a base pointer still
+// releases the right size, since the classes using it have virtual
+// destructors.
+template<MemoryKind Kind>
+struct TrackedAllocation {
+    static void* operator new(size_t bytes) {
+        return allocateTracked(bytes, Kind);
+    }
+
+    static void operator delete(void* ptr, size_t bytes) noexcept {
+        releaseTracked(ptr, bytes, Kind);
+    }
+};
\ No newline at end of file
@@ -0,0 +1,430 @@
+#include <algorithm>
+#include <cmath>
+
+#include "optimizer.hpp"
+#include "parser.hpp"
+#include "valueTable.hpp"
+
+size_t nodeSize(const Ref<Node>& node) {
+    size_t size = 1;
+
+    if (const FunctionApplication* app = node->as<FunctionApplication>()) {
+        for (const Ref<Node> &arg : app->arguments) {
+            size += nodeSize(arg);
+        }
+    }
+    else if (const ListLiteralNode* lst = node->as<ListLiteralNode>()) {
+        for (const Ref<Node> &item : lst->contents) {
+            size += nodeSize(item);
+        }
+    }
+    else if (const FunctionDefinition* def = node->as<FunctionDefinition>()) {
+        size += nodeSize(def->definition);
+    }
+    return size;
+}
+
+bool callsFunction(const Ref<Node>& node, const FunctionKey& key) {
+    if (const FunctionApplication* app = node->as<FunctionApplication>()) {
+        if (app->token.data == key.first && app->arguments.size() == key.second) {
+            return true;
+        }
+        for (const Ref<Node> &arg : app->arguments) {
+            if (callsFunction(arg, key)) {
+                return true;
+            }
+        }
+    }
+    else if (const ListLiteralNode* lst = node->as<ListLiteralNode>()) {
+        for (const Ref<Node> &item : lst->contents) {
+            if (callsFunction(item, key)) {
+                return true;
+            }
+        }
+    }
+    else if (const FunctionDefinition* def = node->as<FunctionDefinition>()) {
+        return callsFunction(def->definition, key);
+    }
+    return false;
+}
+
+void collectCalls(const Ref<Node>& node, std::set<FunctionKey>& calls) {
+    if (const FunctionApplication* app = node->as<FunctionApplication>()) {
+        calls.insert(FunctionKey(app->token.data, app->arguments.size()));
+        for (const Ref<Node> &arg : app->arguments) {
+            collectCalls(arg, calls);
+        }
+    }
+    else if (const ListLiteralNode* lst = node->as<ListLiteralNode>()) {
+        for (const Ref<Node> &item : lst->contents) {
+            collectCalls(item, calls);
+        }
+    }
+    else if (const FunctionDefinition* def = node->as<FunctionDefinition>()) {
+        collectCalls(def->definition, calls);
+    }
+}
+
+namespace {
+
+bool containsDefinition(const Ref<Node>& node) {
+    if (node->as<FunctionDefinition>() || node->as<DefaultFunctionNode>()) {
+        return true;
+    }
+    if (const FunctionApplication* app = node->as<FunctionApplication>()) {
+        for (const Ref<Node> &arg : app->arguments) {
+            if (containsDefinition(arg)) {
+                return true;
+            }
+        }
+    }
+    else if (const ListLiteralNode* lst = node->as<ListLiteralNode>()) {
+        for (const Ref<Node> &item : lst->contents) {
+            if (containsDefinition(item)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Call-by-name: every #n of the callee becomes the caller's n-th argument
+// subtree, which is then evaluated in the caller's scope exactly as nth() would.
+Ref<Node> substitute(const Ref<Node>& node, const std::vector<Ref<Node>>& args) {
+    if (node->as<ArgumentNode>()) {
+        return args[std::stoi(node->token.data)];
+    }
+    if (const FunctionApplication* app = node->as<FunctionApplication>()) {
+        std::vector<Ref<Node>> newArgs;
+        for (const Ref<Node> &arg : app->arguments) {
+            newArgs.push_back(substitute(arg, args));
+        }
+        return makeRef<FunctionApplication>(app->token, newArgs);
+    }
+    if (const ListLiteralNode* lst = node->as<ListLiteralNode>()) {
+        std::vector<Ref<Node>> newContents;
+        for (const Ref<Node> &item : lst->contents) {
+            newContents.push_back(substitute(item, args));
+        }
+        return makeRef<ListLiteralNode>(lst->token, newContents);
+    }
+    return node;
+}
+
+size_t substitutedSize(const Ref<Node>& node, const std::vector<size_t>& argSizes) {
+    if (node->as<ArgumentNode>()) {
+        return argSizes[std::stoi(node->token.data)];
+    }
+
+    size_t size = 1;
+    if (const FunctionApplication* app = node->as<FunctionApplication>()) {
+        for (const Ref<Node> &arg : app->arguments) {
+            size += substitutedSize(arg, argSizes);
+        }
+    }
+    else if (const ListLiteralNode* lst = node->as<ListLiteralNode>()) {
+        for (const Ref<Node> &item : lst->contents) {
+            size += substitutedSize(item, argSizes);
+        }
+    }
+    return size;
+}
+
+bool isLiteral(const Ref<Node>& node) {
+    return node->as<IntNode>() || node->as<DoubleNode>();
+}
+
+void countArguments(const Ref<Node>& node, std::vector<size_t>& uses) {
+    if (node->as<ArgumentNode>()) {
+        ++uses[std::stoi(node->token.data)];
+    }
+    else if (const FunctionApplication* app = node->as<FunctionApplication>()) {
+        for (const Ref<Node> &arg : app->arguments) {
+            countArguments(arg, uses);
+        }
+    }
+    else if (const ListLiteralNode* lst = node->as<ListLiteralNode>()) {
+        for (const Ref<Node> &item : lst->contents) {
+            countArguments(item, uses);
+        }
+    }
+}
+
+// Substituting an argument into more than one place would evaluate it once
+// per place instead of once per call, so only literals and the caller's own
+// parameters may be shared that way.
+bool keepsSharing(const Ref<Node>& body, const std::vector<Ref<Node>>& args) {
+    std::vector<size_t> uses(args.size());
+    countArguments(body, uses);
+    for (size_t i = 0; i < args.size(); ++i) {
+        if (uses[i] > 1 && !isLiteral(args[i]) && !args[i]->as<ArgumentNode>()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Literal node for a folded result. Big integers stay computed at run time,
+// since reading them back from text would cost more than computing them,
+// and subnormal reals would not read back through std::stod.
+Ref<Node> literalFor(const Value& value, const Token& at) {
+    if (const IntValue* num = value.as<IntValue>()) {
+        return makeRef<IntNode>(Token{Token::Type::KW_INT, std::to_string(num->value), at.startIdx});
+    }
+    const RealValue* num = value.as<RealValue>();
+    if (num && std::fpclassify(num->value) != FP_SUBNORMAL) {
+        return makeRef<DoubleNode>(Token{Token::Type::KW_DOUBLE, value.toString(), at.startIdx});
+    }
+    return nullptr;
+}
+
+class Specializer {
+public:
+    explicit Specializer(GlobalScope& globalScope) : globalScope(globalScope), root(globalScope) {}
+
+    Ref<Node> rewrite(const Ref<Node>& node, std::set<FunctionKey>& used);
+
+private:
+    bool isTrue(const Ref<Node>& condition);
+    Ref<Node> fold(Builtin id, const std::vector<Ref<Node>>& args, const Token& at);
+    const Specialization* specialize(const FunctionKey& callee, const std::vector<Ref<Node>>& args, FunctionKey& key);
+    std::set<FunctionKey> reachableFrom(const FunctionKey& key) const;
+
+    GlobalScope& globalScope;
+    FunctionScope root;
+    size_t budget = specializationBudget;
+    // Clones in order of creation, so a clone that turns out too big can be
+    // dropped along with the ones made while building it.
+    std::vector<FunctionKey> created;
+};
+
+Ref<Node> Specializer::rewrite(const Ref<Node>& node, std::set<FunctionKey>& used) {
+    if (const ListLiteralNode* lst = node->as<ListLiteralNode>()) {
+        std::vector<Ref<Node>> newContents;
+        for (const Ref<Node> &item : lst->contents) {
+            newContents.push_back(rewrite(item, used));
+        }
+        return makeRef<ListLiteralNode>(lst->token, newContents);
+    }
+
+    const FunctionApplication* app = node->as<FunctionApplication>();
+    if (!app) {
+        return node;
+    }
+
+    const FunctionKey callee(app->token.data, app->arguments.size());
+    const FunctionDefinition* def = globalScope.findDefinition(callee.first, callee.second);
+    const DefaultFunctionNode* builtin = def ? def->definition->as<DefaultFunctionNode>() : nullptr;
+
+    // A literal condition picks its branch before the other one is looked
+    // at, so recursion it guards unrolls no further than it would run.
+    if (builtin && builtin->id == Builtin::IF) {
+        const Ref<Node> condition = rewrite(app->arguments[0], used);
+        if (isLiteral(condition)) {
+            used.insert(callee);
+            return rewrite(app->arguments[isTrue(condition) ? 1 : 2], used);
+        }
+        return makeRef<FunctionApplication>(app->token, std::vector<Ref<Node>>{condition, rewrite(app->arguments[1], used), rewrite(app->arguments[2], used)});
+    }
+
+    std::vector<Ref<Node>> newArgs;
+    for (const Ref<Node> &arg : app->arguments) {
+        newArgs.push_back(rewrite(arg, used));
+    }
+
+    if (builtin) {
+        if (Ref<Node> folded = fold(builtin->id, newArgs, app->token)) {
+            used.insert(callee);
+            return folded;
+        }
+    }
+    else if (std::any_of(newArgs.begin(), newArgs.end(), isLiteral)) {
+        FunctionKey key;
+        if (const Specialization* spec = specialize(callee, newArgs, key)) {
+            used.insert(spec->uses.begin(), spec->uses.end());
+
+            std::vector<Ref<Node>> rest;
+            bool trivial = true;
+            for (const Ref<Node> &arg : newArgs) {
+                if (!isLiteral(arg)) {
+                    rest.push_back(arg);
+                    trivial = trivial && arg->as<ArgumentNode>();
+                }
+            }
+
+            // Only trivial arguments are substituted, so unrolling never
+            // duplicates work.
+            if (spec->definition && trivial && nodeSize(spec->definition->definition) <= inlineCalleeBudget &&
+                !callsFunction(spec->definition->definition, key)) {
+                return substitute(spec->definition->definition, rest);
+            }
+            return makeRef<FunctionApplication>(Token{Token::Type::FUNC, key.first, app->token.startIdx}, rest);
+        }
+    }
+    return makeRef<FunctionApplication>(app->token, newArgs);
+}
+
+// if() itself decides which branch a literal condition takes.
+bool Specializer::isTrue(const Ref<Node>& condition) {
+    const Ref<Value> probe[] = {condition->eval(root), makeInt(1), makeInt(0)};
+    FunctionScope scope(globalScope, probe, 3);
+    return callBuiltin(Builtin::IF, scope)->as<IntValue>()->value != 0;
+}
+
+Ref<Node> Specializer::fold(Builtin id, const std::vector<Ref<Node>>& args, const Token& at) {
+    if (!std::all_of(args.begin(), args.end(), isLiteral)) {
+        return nullptr;
+    }
+
+    std::vector<Ref<Value>> values;
+    for (const Ref<Node> &arg : args) {
+        values.push_back(arg->eval(root));
+    }
+    try {
+        FunctionScope scope(globalScope, values.data(), values.size());
+        return literalFor(*callBuiltin(id, scope), at);
+    } catch (const std::runtime_error &) {
+        // Left to fail at run time, where the error belongs.
+        return nullptr;
+    }
+}
+
+const Specialization* Specializer::specialize(const FunctionKey& callee, const std::vector<Ref<Node>>& args, FunctionKey& key) {
+    const Ref<FunctionDefinition> source = globalScope.findSource(callee.first, callee.second);
+    if (!source || containsDefinition(source->definition)) {
+        return nullptr;
+    }
+
+    // The clone takes the remaining parameters in their original order.
+    std::vector<Ref<Node>> bindings;
+    key = FunctionKey(callee.first + '{', 0);
+    for (size_t i = 0; i < args.size(); ++i) {
+        key.first += i ? "," : "";
+        if (isLiteral(args[i])) {
+            key.first += args[i]->token.data;
+            bindings.push_back(args[i]);
+        }
+        else {
+            key.first += '_';
+            bindings.push_back(makeRef<ArgumentNode>(Token{Token::Type::ARG, std::to_string(key.second++), -1}));
+        }
+    }
+    key.first += '}';
+
+    // Also reached while the clone is still being built: recursion on the
+    // same literals becomes a call to the clone itself.
+    if (const Specialization* known = globalScope.findSpecialization(key)) {
+        return known;
+    }
+    // The source size is reserved up front, which also bounds how deep
+    // clones can nest while none of them is finished.
+    const size_t reserved = nodeSize(source->definition);
+    if (reserved > budget) {
+        return nullptr;
+    }
+
+    const size_t createdBefore = created.size();
+    const size_t budgetBefore = budget;
+    budget -= reserved;
+    Specialization spec = {nullptr, reachableFrom(callee)};
+    globalScope.addSpecialization(key, spec);
+    created.push_back(key);
+
+    std::vector<FunctionKey> expanding = {callee};
+    std::set<FunctionKey> inlined, used;
+    const Ref<Node> body = rewrite(substitute(inlineCalls(source->definition, expanding, globalScope, inlined), bindings), used);
+
+    const size_t size = nodeSize(body);
+    budget += reserved;
+    if (size > budget) {
+        for (size_t i = createdBefore; i < created.size(); ++i) {
+            globalScope.removeSpecialization(created[i]);
+        }
+        created.resize(createdBefore);
+        budget = budgetBefore;
+        return nullptr;
+    }
+    budget -= size;
+
+    spec.definition = makeRef<FunctionDefinition>(Token{Token::Type::FUNC, key.first, source->token.startIdx}, body);
+    globalScope.addSpecialization(key, spec);
+    return globalScope.findSpecialization(key);
+}
+
+// Everything the callee's source can reach, through any number of calls.
+std::set<FunctionKey> Specializer::reachableFrom(const FunctionKey& key) const {
+    std::set<FunctionKey> reached = {key};
+    std::vector<FunctionKey> pending = {key};
+
+    while (!pending.empty()) {
+        const Ref<FunctionDefinition> source = globalScope.findSource(pending.back().first, pending.back().second);
+        pending.pop_back();
+        if (!source) {
+            continue;
+        }
+
+        std::set<FunctionKey> calls;
+        collectCalls(source->definition, calls);
+        for (const FunctionKey &call : calls) {
+            if (reached.insert(call).second) {
+                pending.push_back(call);
+            }
+        }
+    }
+    return reached;
+}
+
+}
+
+Ref<Node> inlineCalls(const Ref<Node>& body, std::vector<FunctionKey>& expanding, const GlobalScope& globalScope, std::set<FunctionKey>& inlined) {
+    if (const ListLiteralNode* lst = body->as<ListLiteralNode>()) {
+        std::vector<Ref<Node>> newContents;
+        for (const Ref<Node> &item : lst->contents) {
+            newContents.push_back(inlineCalls(item, expanding, globalScope, inlined));
+        }
+        return makeRef<ListLiteralNode>(lst->token, newContents);
+    }
+
+    const FunctionApplication* app = body->as<FunctionApplication>();
+    if (!app) {
+        return body;
+    }
+
+    std::vector<Ref<Node>> newArgs;
+    for (const Ref<Node> &arg : app->arguments) {
+        newArgs.push_back(inlineCalls(arg, expanding, globalScope, inlined));
+    }
+
+    const FunctionKey callee(app->token.data, newArgs.size());
+    const Ref<FunctionDefinition> calleeDef = globalScope.findSource(callee.first, callee.second);
+
+    if (calleeDef && std::find(expanding.begin(), expanding.end(), callee) == expanding.end()
+        && !containsDefinition(calleeDef->definition)
+        && nodeSize(calleeDef->definition) <= inlineCalleeBudget
+        && !callsFunction(calleeDef->definition, callee)) {
+        std::set<FunctionKey> calleeInlined;
+
+        expanding.push_back(callee);
+        const Ref<Node> calleeBody = inlineCalls(calleeDef->definition, expanding, globalScope, calleeInlined);
+        expanding.pop_back();
+
+        std::vector<size_t> argSizes;
+        for (const Ref<Node> &arg : newArgs) {
+            argSizes.push_back(nodeSize(arg));
+        }
+
+        if (substitutedSize(calleeBody, argSizes) <= inlineExpansionBudget && keepsSharing(calleeBody, newArgs)) {
+            inlined.insert(callee);
+            inlined.insert(calleeInlined.begin(), calleeInlined.end());
+            return substitute(calleeBody, newArgs);
+        }
+    }
+
+    return makeRef<FunctionApplication>(app->token, newArgs);
+}
+
+
+Ref<Node> specializeCalls(const Ref<Node>& body, GlobalScope& globalScope, std::set<FunctionKey>& used) {
+    Specializer specializer(globalScope);
+    return specializer.rewrite(body, used);
+}
\ No newline at end of file
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <set>
+#include <vector>
+
+#include "interpreter.hpp"
+
+struct Node;
+
+// A callee is inlined only if its body has at most inlineCalleeBudget nodes
+// and the substituted body (callee plus argument subtrees) stays within
+// inlineExpansionBudget nodes.
+constexpr size_t inlineCalleeBudget = 16;
+constexpr size_t inlineExpansionBudget = 64;
+// Nodes all the clones made while optimizing one function may add up to.
+constexpr size_t specializationBudget = 256;
+
+size_t nodeSize(const Ref<Node>& node);
+
+bool callsFunction(const Ref<Node>& node, const FunctionKey& key);
+
+// Adds every (name, argc) called anywhere inside `node` to `calls`.
+void collectCalls(const Ref<Node>& node, std::set<FunctionKey>& calls);
+
+// Substitutes the source bodies of small, non-recursive user functions into
+// `body`. Functions on the `expanding` stack are never unfolded again. Every
+// function whose source ended up in the result, directly or through a nested
+// inline, is recorded in `inlined`.
+Ref<Node> inlineCalls(const Ref<Node>& body, std::vector<FunctionKey>& expanding, const GlobalScope& globalScope, std::set<FunctionKey>& inlined);
+
+
+// Folds builtin calls whose arguments are numeric literals, and if() with a
+// literal condition, in `body`. A call to a user function that passes
+// literals for some parameters is redirected to a clone of the callee with
+// those parameters replaced by the literals, itself folded and specialized
+// in turn; recursion on literals thereby unrolls until the budget runs out.
+// Clones small enough to inline are substituted into the call site. Every
+// function the result depends on is added to `used`.
+Ref<Node> specializeCalls(const Ref<Node>& body, GlobalScope& globalScope, std::set<FunctionKey>& used);
\ No newline at end of file
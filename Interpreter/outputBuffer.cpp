@@ -0,0 +1,55 @@
+#include <charconv>
+
+#include "outputBuffer.hpp"
+
+OutputBuffer::OutputBuffer(std::ostream& stream, size_t capacity) : stream(stream), capacity(capacity) {}
+
+OutputBuffer::~OutputBuffer() {
+    flush();
+}
+
+OutputBuffer& OutputBuffer::operator<<(const std::string& text) {
+    buffer += text;
+    flushIfFull();
+    return *this;
+}
+
+OutputBuffer& OutputBuffer::operator<<(const char* text) {
+    buffer += text;
+    flushIfFull();
+    return *this;
+}
+
+OutputBuffer& OutputBuffer::operator<<(char ch) {
+    buffer += ch;
+    flushIfFull();
+    return *this;
+}
+
+OutputBuffer& OutputBuffer::operator<<(size_t number) {
+    char digits[24];
+    buffer.append(digits, std::to_chars(digits, digits + sizeof(digits), number).ptr);
+    flushIfFull();
+    return *this;
+}
+
+OutputBuffer& OutputBuffer::operator<<(const Value& value) {
+    value.format(buffer);
+    flushIfFull();
+    return *this;
+}
+
+void OutputBuffer::flush() {
+    if (!buffer.empty()) {
+        stream.write(buffer.data(), buffer.size());
+        buffer.clear();
+    }
+    stream.flush();
+}
+
+void OutputBuffer::flushIfFull() {
+    if (buffer.size() >= capacity) {
+        stream.write(buffer.data(), buffer.size());
+        buffer.clear();
+    }
+}
\ No newline at end of file
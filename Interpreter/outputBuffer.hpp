@@ -0,0 +1,35 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+
+#include "returnValue.hpp"
+
+// Collects output in memory and hands it to the underlying stream in large
+// writes. Callers flush at batch boundaries: before blocking on input,
+// before writing to another stream and when a script finishes.
+class OutputBuffer {
+public:
+    static constexpr size_t defaultCapacity = 1 << 20;
+
+    explicit OutputBuffer(std::ostream& stream, size_t capacity = defaultCapacity);
+    ~OutputBuffer();
+
+    OutputBuffer(const OutputBuffer&) = delete;
+    OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+    OutputBuffer& operator<<(const std::string& text);
+    OutputBuffer& operator<<(const char* text);
+    OutputBuffer& operator<<(char ch);
+    OutputBuffer& operator<<(size_t number);
+    OutputBuffer& operator<<(const Value& value);
+
+    void flush();
+
+private:
+    void flushIfFull();
+
+    std::ostream& stream;
+    std::string buffer;
+    size_t capacity;
+};
\ No newline at end of file
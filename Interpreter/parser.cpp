@@ -1,51 +1,99 @@
+#include <cerrno>
+#include <cstdlib>
+
+#include "evaluation.hpp"
 #include "parser.hpp"
 #include "interpreter.hpp"
+#include "valueTable.hpp"
 
-Node::Node(Token token) : token(token) {}
+Node::Node(Kind kind, Token token) : kind(kind), token(token) {}
 
-IntNode::IntNode(Token token) : Node(token) {}
+IntNode::IntNode(Token token) : Node(nodeKind, token) {}
 
-std::shared_ptr<Value> IntNode::eval(FunctionScope &fncScp) const {
-    return std::dynamic_pointer_cast<Value>(std::make_shared<IntValue>(std::stoi(token.data)));
+Ref<Value> IntNode::eval(FunctionScope &fncScp) const {
+    errno = 0;
+    const long long value = std::strtoll(token.data.c_str(), nullptr, 10);
+    if (errno == ERANGE) {
+        return makeInteger(BigInt(token.data));
+    }
+    return makeInt(value);
 }
 
-DoubleNode::DoubleNode(Token token) : Node(token) {}
+DoubleNode::DoubleNode(Token token) : Node(nodeKind, token) {}
 
-std::shared_ptr<Value> DoubleNode::eval(FunctionScope &fncScp) const {
-    return std::dynamic_pointer_cast<Value>(std::make_shared<RealValue>(std::stod(token.data)));
+Ref<Value> DoubleNode::eval(FunctionScope &fncScp) const {
+    return makeReal(std::stod(token.data));
 }
 
-ArgumentNode::ArgumentNode(Token token) : Node(token) {}
+ArgumentNode::ArgumentNode(Token token) : Node(nodeKind, token) {}
 
-std::shared_ptr<Value> ArgumentNode::eval(FunctionScope &fncScp) const {
+Ref<Value> ArgumentNode::eval(FunctionScope &fncScp) const {
     return fncScp.nth(std::stoi(token.data));
 }
 
-ListLiteralNode::ListLiteralNode(Token token, const std::vector<std::shared_ptr<Node>> &contents) : Node(token), contents(contents) {}
+ListLiteralNode::ListLiteralNode(Token token, const std::vector<Ref<Node>> &contents) : Node(nodeKind, token), contents(contents) {}
 
-std::shared_ptr<Value> ListLiteralNode::eval(FunctionScope &fncScp) const {
-    std::vector<std::shared_ptr<Value>> list;
+Ref<Value> ListLiteralNode::eval(FunctionScope &fncScp) const {
+    std::vector<Ref<Value>> list;
 
-    for (std::shared_ptr<Node> item : contents) {
+    for (Ref<Node> item : contents) {
         list.push_back(item->eval(fncScp));
     }
 
-    return std::dynamic_pointer_cast<Value>(std::make_shared<ListLiteralValue>(list));
+    return makeList(list);
 }
 
-std::shared_ptr<Value> FunctionDefinition::eval(FunctionScope &fncScp) const {
-    std::dynamic_pointer_cast<Value>(std::make_shared<IntValue>(fncScp.getGlobalScope().addFunction(std::make_shared<FunctionDefinition>(*this))));
+Ref<Value> FunctionDefinition::eval(FunctionScope &fncScp) const {
+    fncScp.getGlobalScope().addFunction(makeRef<FunctionDefinition>(token, definition));
     return nullptr;
 }
 
-std::shared_ptr<Value> FunctionApplication::eval(FunctionScope &parentScope) const {
-    FunctionScope localScope(parentScope.getGlobalScope(), std::make_shared<FunctionScope>(parentScope), arguments);
-    
-    return parentScope.getGlobalScope().callFunction(token.data, localScope);
+Ref<Value> FunctionApplication::eval(FunctionScope &parentScope) const {
+    // Entered before the arguments are evaluated, so the depth limit also
+    // covers the native stack used by forced arguments.
+    CallGuard guard;
+    GlobalScope &globalScope = parentScope.getGlobalScope();
+    const FunctionDefinition *def = globalScope.findDefinition(token.data, arguments.size());
+    if (!def) {
+        throw std::runtime_error("Called function which is not defined");
+    }
+
+    if (def->strictArguments == 0) {
+        FunctionScope localScope(globalScope, parentScope, arguments);
+        return globalScope.callFunction(*def, localScope);
+    }
+
+    // Arguments the callee is sure to force are evaluated once, here, and
+    // passed as values; the others stay deferred.
+    Ref<Value> inlineValues[maxInlineArguments];
+    std::vector<Ref<Value>> values;
+    Ref<Value> *forced = inlineValues;
+    if (arguments.size() > maxInlineArguments) {
+        values.resize(arguments.size());
+        forced = values.data();
+    }
+
+    const size_t generation = globalScope.getGeneration();
+    for (size_t i = 0; i < arguments.size(); ++i) {
+        if (def->isStrictIn(i)) {
+            forced[i] = arguments[i]->eval(parentScope);
+        }
+    }
+
+    // An argument may itself contain a definition that replaced the callee.
+    if (globalScope.getGeneration() != generation) {
+        def = globalScope.findDefinition(token.data, arguments.size());
+        if (!def) {
+            throw std::runtime_error("Called function which is not defined");
+        }
+    }
+
+    FunctionScope localScope(globalScope, parentScope, arguments, forced);
+    return globalScope.callFunction(*def, localScope);
 }
 
-std::shared_ptr<Node> Parser::parse(std::ostream& out) {
-    std::shared_ptr<Node> ast = expr(out);
+Ref<Node> Parser::parse(std::ostream& out) {
+    Ref<Node> ast = expr(out);
 
     if (eof()) {
         return ast;
@@ -60,7 +108,7 @@ bool Parser::eof() {
 
 Parser::Parser(std::vector<Token>::iterator begin) : curr(begin) {}
 
-std::shared_ptr<Node> Parser::expr(std::ostream& out) {
+Ref<Node> Parser::expr(std::ostream& out) {
     if (eof()) {
         throw std::runtime_error("Insufficient input provided.\n");
     }
@@ -90,14 +138,14 @@ std::shared_ptr<Node> Parser::expr(std::ostream& out) {
 
         ++curr;
 
-        return std::dynamic_pointer_cast<Node>(std::make_shared<ArgumentNode>(tempToken));
+        return makeRef<ArgumentNode>(tempToken);
     }
     if (curr->type == Token::Type::KW_INT) {
         Token tempToken = *curr;
 
         ++curr;
 
-        return std::dynamic_pointer_cast<Node>(std::make_shared<IntNode>(tempToken));
+        return makeRef<IntNode>(tempToken);
     }
 
     if (curr->type == Token::Type::KW_DOUBLE) {
@@ -105,7 +153,7 @@ std::shared_ptr<Node> Parser::expr(std::ostream& out) {
 
         ++curr;
 
-        return std::dynamic_pointer_cast<Node>(std::make_shared<DoubleNode>(tempToken));
+        return makeRef<DoubleNode>(tempToken);
     }
 
     if (curr->type == Token::Type::OPEN_SQUARE) {
@@ -113,10 +161,10 @@ std::shared_ptr<Node> Parser::expr(std::ostream& out) {
 
         ++curr;
 
-        std::vector<std::shared_ptr<Node>> arguments;
+        std::vector<Ref<Node>> arguments;
 
         while(curr->type != Token::Type::eof && curr->type != Token::Type::CLOSE_SQUARE) {
-            std::shared_ptr<Node> elem = expr(out);
+            Ref<Node> elem = expr(out);
 
             if (!elem) {
                 std::string err = "Parsing List Literal error occurred";
@@ -127,7 +175,7 @@ std::shared_ptr<Node> Parser::expr(std::ostream& out) {
 
         if (curr->type == Token::Type::CLOSE_SQUARE) {
             ++curr;
-            return std::dynamic_pointer_cast<Node>(std::make_shared<ListLiteralNode>(returnToken, arguments));
+            return makeRef<ListLiteralNode>(returnToken, arguments);
         }
 
         std::string err = "Expected ']'";
@@ -145,10 +193,10 @@ std::shared_ptr<Node> Parser::expr(std::ostream& out) {
 
         ++curr;
 
-        std::vector<std::shared_ptr<Node>> arguments;
+        std::vector<Ref<Node>> arguments;
 
         while (curr->type != Token::Type::eof && curr->type != Token::Type::CLOSE_ROUND) {
-            std::shared_ptr<Node> elem = expr(out);
+            Ref<Node> elem = expr(out);
 
             if (!elem) {
                 std::string err = "Parsing List Function Call error occurred";
@@ -164,7 +212,7 @@ std::shared_ptr<Node> Parser::expr(std::ostream& out) {
 
         if (curr->type == Token::Type::CLOSE_ROUND) {
             ++curr;
-            return std::dynamic_pointer_cast<Node>(std::make_shared<ListLiteralNode>(returnToken, arguments));
+            return makeRef<ListLiteralNode>(returnToken, arguments);
         }
 
         std::string err = "Expected ')'";
@@ -181,13 +229,13 @@ std::shared_ptr<Node> Parser::expr(std::ostream& out) {
     if (curr->type == Token::Type::ARROW) {
         ++curr;
 
-        std::shared_ptr<Node> definition = expr(out);
+        Ref<Node> definition = expr(out);
 
         if (definition == nullptr) {
             throw std::runtime_error("Problem while parsing function definition\n");
         }
 
-        return std::dynamic_pointer_cast<Node>(std::make_shared<FunctionDefinition>(f, definition));
+        return makeRef<FunctionDefinition>(f, definition);
     }
 
     if (curr->type != Token::Type::OPEN_ROUND) {
@@ -197,11 +245,11 @@ std::shared_ptr<Node> Parser::expr(std::ostream& out) {
 
     ++curr;
 
-    std::vector<std::shared_ptr<Node>> args;
+    std::vector<Ref<Node>> args;
     bool hasMoreArgs = true;
 
     while (!eof() && curr->type != Token::Type::CLOSE_ROUND && hasMoreArgs) {
-        std::shared_ptr<Node> arg = expr(out);
+        Ref<Node> arg = expr(out);
 
         if (arg.get() == nullptr || curr->type == Token::Type::eof) {
             std::string err = "Problem while parsing function call.";
@@ -219,5 +267,5 @@ std::shared_ptr<Node> Parser::expr(std::ostream& out) {
         throw std::runtime_error(err);
     }
     ++curr;
-    return std::dynamic_pointer_cast<Node>(std::make_shared<FunctionApplication>(f, args));
+    return makeRef<FunctionApplication>(f, args);
 }
\ No newline at end of file
@@ -1,52 +1,76 @@
 #pragma once
 
-#include <functional>
-#include <memory>
 #include <cmath>
 
+#include "builtins.hpp"
+#include "flatCode.hpp"
 #include "lexer.hpp"
+#include "memory.hpp"
 #include "returnValue.hpp"
 
 struct FunctionScope;
 
-struct Node {
+struct Node : public SharedRefCounted, public TrackedAllocation<MemoryKind::NODE> {
+    enum class Kind {
+        INT,
+        DOUBLE,
+        LIST_LITERAL,
+        ARGUMENT,
+        FUNCTION_DEFINITION,
+        FUNCTION_APPLICATION,
+        DEFAULT_FUNCTION,
+    };
+
+    Kind kind;
     Token token;
 
-	explicit Node(Token token);
+	Node(Kind kind, Token token);
 
-    virtual std::shared_ptr<Value> eval(FunctionScope &fncScp) const = 0;
+    template<class T>
+    T* as() { return kind == T::nodeKind ? static_cast<T*>(this) : nullptr; }
+
+    template<class T>
+    const T* as() const { return kind == T::nodeKind ? static_cast<const T*>(this) : nullptr; }
+
+    virtual Ref<Value> eval(FunctionScope &fncScp) const = 0;
 
     virtual size_t getArgc() const = 0;
 
 };
 
 struct IntNode : public Node {
+    static constexpr Kind nodeKind = Kind::INT;
+
 	explicit IntNode(Token token);
 
-    std::shared_ptr<Value> eval(FunctionScope &fncScp) const;
+    Ref<Value> eval(FunctionScope &fncScp) const;
 
     size_t getArgc() const { return 0; }
 
 };
 
 struct DoubleNode : public Node {
+    static constexpr Kind nodeKind = Kind::DOUBLE;
+
 	explicit DoubleNode(Token token);
 
-    std::shared_ptr<Value>eval(FunctionScope &fncScp) const;
+    Ref<Value>eval(FunctionScope &fncScp) const;
 
     size_t getArgc() const { return 0; }
 };
 
 struct ListLiteralNode : public Node {
-	std::vector<std::shared_ptr<Node>> contents;
+    static constexpr Kind nodeKind = Kind::LIST_LITERAL;
+
+	std::vector<Ref<Node>> contents;
 
-	ListLiteralNode(Token token, const std::vector<std::shared_ptr<Node>> &contents);
+	ListLiteralNode(Token token, const std::vector<Ref<Node>> &contents);
 
-    std::shared_ptr<Value> eval(FunctionScope &fncScp) const;
+    Ref<Value> eval(FunctionScope &fncScp) const;
 
     size_t getArgc() const {
         size_t res = 0;
-        for (std::shared_ptr<Node> node : contents) {
+        for (Ref<Node> node : contents) {
             res = std::max(res, node->getArgc());
         }
         return res;
@@ -54,9 +78,11 @@ struct ListLiteralNode : public Node {
 };
 
 struct ArgumentNode : public Node {
+    static constexpr Kind nodeKind = Kind::ARGUMENT;
+
 	explicit ArgumentNode(Token token);
 
-    std::shared_ptr<Value> eval(FunctionScope &fncScp) const;
+    Ref<Value> eval(FunctionScope &fncScp) const;
 
     size_t getArgc() const {
         return std::stoi(token.data) + 1;
@@ -64,11 +90,24 @@ struct ArgumentNode : public Node {
 };
 
 struct FunctionDefinition : public Node {
-    const std::shared_ptr<Node> definition;
+    static constexpr Kind nodeKind = Kind::FUNCTION_DEFINITION;
 
-    FunctionDefinition(Token token, const std::shared_ptr<Node> definition) : Node(token), definition(definition) {}
+    const Ref<Node> definition;
+    // Bit i is set if evaluating the body always forces #i, so callers may
+    // evaluate that argument up front (see strictness.hpp).
+    uint64_t strictArguments = 0;
+    // What the body yields if it returns, see typeInference.hpp.
+    ValueKind resultKind = ValueKind::UNKNOWN;
+    // The body flattened for evaluation, or null to walk `definition`.
+    Ref<FlatCode> code;
 
-    std::shared_ptr<Value> eval(FunctionScope &fncScp) const;
+    FunctionDefinition(Token token, const Ref<Node> definition) : Node(nodeKind, token), definition(definition) {}
+
+    Ref<Value> eval(FunctionScope &fncScp) const;
+
+    bool isStrictIn(size_t idx) const {
+        return idx < 64 && ((strictArguments >> idx) & 1) != 0;
+    }
 
     size_t getArgc() const {
         return definition->getArgc();
@@ -76,16 +115,21 @@ struct FunctionDefinition : public Node {
 };
 
 struct FunctionApplication : public Node {
-    const std::vector<std::shared_ptr<Node>> arguments;
+    static constexpr Kind nodeKind = Kind::FUNCTION_APPLICATION;
 
-    FunctionApplication(Token token, const std::vector<std::shared_ptr<Node>> &arguments) : Node(token), arguments(arguments) {}
+    // Calls with at most this many arguments keep forced values on the stack.
+    static constexpr size_t maxInlineArguments = 8;
+
+    const std::vector<Ref<Node>> arguments;
+
+    FunctionApplication(Token token, const std::vector<Ref<Node>> &arguments) : Node(nodeKind, token), arguments(arguments) {}
 	~FunctionApplication() = default;
 
-    std::shared_ptr<Value> eval(FunctionScope &parentScp) const;
+    Ref<Value> eval(FunctionScope &parentScp) const;
 
     size_t getArgc() const {
         size_t res = 0;
-        for (std::shared_ptr<Node> node : arguments) {
+        for (Ref<Node> node : arguments) {
             res = std::max(res, node->getArgc());
         }
         return res;
@@ -93,28 +137,29 @@ struct FunctionApplication : public Node {
 };
 
 struct DefaultFunctionNode : public Node {
-    const std::function<std::shared_ptr<Value>(FunctionScope&)> func;
-    const size_t argc;
+    static constexpr Kind nodeKind = Kind::DEFAULT_FUNCTION;
+
+    const Builtin id;
 
-    DefaultFunctionNode(const std::string &name, const std::function<std::shared_ptr<Value>(FunctionScope&)>& func, size_t argc) 
-    : Node({Token::Type::FUNC, name, -1}), func(func), argc(argc) {}
+    explicit DefaultFunctionNode(Builtin id)
+    : Node(nodeKind, {Token::Type::FUNC, builtinInfo(id).name, -1}), id(id) {}
 
-    std::shared_ptr<Value> eval(FunctionScope &fncScp) const {
-        return func(fncScp);
+    Ref<Value> eval(FunctionScope &fncScp) const {
+        return callBuiltin(id, fncScp);
     }
 
     size_t getArgc() const {
-        return argc;
+        return builtinInfo(id).argc;
     }
 };
 
 class Parser {
 public:
     Parser(std::vector<Token>::iterator begin);
-    std::shared_ptr<Node> parse(std::ostream& out);
+    Ref<Node> parse(std::ostream& out);
 
 private:
     std::vector<Token>::iterator curr;
-    std::shared_ptr<Node> expr(std::ostream& out);
+    Ref<Node> expr(std::ostream& out);
     bool eof();
 };
\ No newline at end of file
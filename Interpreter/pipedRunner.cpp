@@ -0,0 +1,93 @@
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "thisFuncSingleton.hpp"
+
+namespace {
+
+constexpr size_t readBlockSize = 1 << 16;
+
+} // namespace
+
+// Lines are cut out of large blocks read straight from the descriptor, and the
+// token vector and line string keep their buffers from one query to the next.
+// Output is only flushed when the buffer fills up and before a read that may
+// block, so a program feeding queries one at a time still sees every answer.
+int ListFunc::runPiped() {
+    std::string input;
+    std::string line;
+    std::vector<Token> tokens;
+    size_t lineStart = 0;
+    bool done = false;
+
+    try {
+        while (!done) {
+            output.flush();
+
+            const size_t kept = input.size() - lineStart;
+            input.erase(0, lineStart);
+            lineStart = 0;
+            input.resize(kept + readBlockSize);
+
+            const ssize_t got = ::read(STDIN_FILENO, &input[kept], readBlockSize);
+            if (got < 0 && errno == EINTR) {
+                input.resize(kept);
+                continue;
+            }
+            input.resize(kept + (got > 0 ? got : 0));
+
+            if (got <= 0) {
+                // A last line without a newline still counts.
+                if (!input.empty()) {
+                    line.assign(input);
+                    runPipedLine(line, tokens);
+                }
+                break;
+            }
+
+            const char *end = input.data() + input.size();
+            while (!done) {
+                const char *begin = input.data() + lineStart;
+                const char *newline = static_cast<const char*>(std::memchr(begin, '\n', end - begin));
+                if (!newline) {
+                    break;
+                }
+
+                line.assign(begin, newline);
+                lineStart += line.size() + 1;
+                done = !runPipedLine(line, tokens);
+            }
+        }
+    } catch (...) {
+        return -1;
+    }
+    output.flush();
+    return 0;
+}
+
+bool ListFunc::runPipedLine(const std::string& line, std::vector<Token>& tokens) {
+    if (line == "exit") {
+        return false;
+    }
+    if (line.empty() || line[0] == '#') {
+        return true;
+    }
+    if (line == ":mem") {
+        output << memoryReport() << '\n';
+        return true;
+    }
+
+    try {
+        Lexer::lex(line, tokens);
+
+        Parser parser(tokens.begin());
+        answer(parser.parse(std::cout), "");
+    } catch (const std::runtime_error &execException) {
+        reportError(execException.what());
+    }
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,309 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <unordered_set>
+#include <vector>
+
+#include "optimizer.hpp"
+#include "parser.hpp"
+#include "queryCache.hpp"
+
+namespace {
+
+// Appends the normalized form of `node` to `out`. Clears `pure` if it
+// contains a definition.
+void normalize(const Node& node, std::string& out, bool& pure) {
+    switch (node.kind) {
+    case Node::Kind::INT:
+    {
+        errno = 0;
+        const long long value = std::strtoll(node.token.data.c_str(), nullptr, 10);
+        if (errno == ERANGE) {
+            out += BigInt(node.token.data).toString();
+        }
+        else {
+            IntValue(value).format(out);
+        }
+        break;
+    }
+    case Node::Kind::DOUBLE:
+        RealValue(std::stod(node.token.data)).format(out);
+        break;
+    case Node::Kind::ARGUMENT:
+        out += '#';
+        out += std::to_string(std::stoul(node.token.data));
+        break;
+    case Node::Kind::LIST_LITERAL:
+    {
+        out += '[';
+        const std::vector<Ref<Node>> &items = node.as<ListLiteralNode>()->contents;
+        for (size_t i = 0; i < items.size(); ++i) {
+            if (i > 0) {
+                out += ',';
+            }
+            normalize(*items[i], out, pure);
+        }
+        out += ']';
+        break;
+    }
+    case Node::Kind::FUNCTION_APPLICATION:
+    {
+        out += node.token.data;
+        out += '(';
+        const std::vector<Ref<Node>> &args = node.as<FunctionApplication>()->arguments;
+        for (size_t i = 0; i < args.size(); ++i) {
+            if (i > 0) {
+                out += ',';
+            }
+            normalize(*args[i], out, pure);
+        }
+        out += ')';
+        break;
+    }
+    case Node::Kind::FUNCTION_DEFINITION:
+        pure = false;
+        out += node.token.data;
+        out += "<-";
+        normalize(*node.as<FunctionDefinition>()->definition, out, pure);
+        break;
+    case Node::Kind::DEFAULT_FUNCTION:
+        out += "builtin:";
+        out += node.token.data;
+        break;
+    }
+}
+
+} // namespace
+
+QueryCache::QueryCache(GlobalScope& globalScope, size_t capacity) : globalScope(globalScope), capacity(capacity) {
+    globalScope.setObserver(this);
+}
+
+QueryCache::~QueryCache() {
+    globalScope.setObserver(nullptr);
+}
+
+void QueryCache::attachFile(const std::string& path) {
+    std::ifstream in(path);
+    std::string line;
+
+    this->path = path;
+    while (std::getline(in, line)) {
+        fileSize += line.size() + 1;
+        const size_t first = line.find('\t');
+        const size_t second = first == std::string::npos ? first : line.find('\t', first + 1);
+        if (second != std::string::npos) {
+            std::string key = line.substr(0, second);
+            persisted[key] = line.substr(second + 1);
+            written.push_back(std::move(key));
+        }
+    }
+    in.close();
+
+    if (fileSize > maxFileSize || written.size() != persisted.size()) {
+        compactFile();
+    }
+    else {
+        file.open(path, std::ios::app);
+    }
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open query cache " + path);
+    }
+}
+
+// Rewrites the file with the newest entries that fit in maxFileSize, each
+// once, and forgets the others. The file is replaced by renaming, so a
+// failure leaves the old one intact; appending then stops.
+void QueryCache::compactFile() {
+    std::unordered_set<std::string> kept;
+    std::vector<std::string> order;
+    size_t size = 0;
+    for (size_t i = written.size(); i-- > 0;) {
+        if (kept.count(written[i])) {
+            continue;
+        }
+        const size_t lineSize = written[i].size() + persisted[written[i]].size() + 2;
+        if (size + lineSize > maxFileSize) {
+            break;
+        }
+        kept.insert(written[i]);
+        order.push_back(written[i]);
+        size += lineSize;
+    }
+    for (auto it = persisted.begin(); it != persisted.end();) {
+        it = kept.count(it->first) ? std::next(it) : persisted.erase(it);
+    }
+    written.assign(order.rbegin(), order.rend());
+
+    file.close();
+    const std::string temporary = path + ".tmp";
+    std::ofstream out(temporary, std::ios::trunc);
+    for (const std::string &key : written) {
+        out << key << '\t' << persisted[key] << '\n';
+    }
+    out.close();
+    if (!out || std::rename(temporary.c_str(), path.c_str()) != 0) {
+        std::remove(temporary.c_str());
+        return;
+    }
+
+    fileSize = size;
+    file.open(path, std::ios::app);
+}
+
+bool QueryCache::prepare(const Ref<Node>& ast, Query& query) const {
+    bool pure = true;
+    query.ast = ast;
+    normalize(*ast, query.text, pure);
+    return pure;
+}
+
+const std::string* QueryCache::find(Query& query) {
+    const auto it = entries.find(query.text);
+    if (it != entries.end()) {
+        ages.splice(ages.end(), ages, it->second.age);
+        ++hits;
+        return &it->second.result;
+    }
+
+    if (file.is_open()) {
+        const auto stored = persisted.find(fingerprintOf(query) + '\t' + query.text);
+        if (stored != persisted.end()) {
+            const std::string text = query.text;
+            callsOf(query);
+            insert(std::move(query.text), std::move(query.calls), stored->second);
+            ++hits;
+            return &entries.find(text)->second.result;
+        }
+    }
+    ++misses;
+    return nullptr;
+}
+
+void QueryCache::store(Query& query, const std::string& result, uint64_t reductions) {
+    if (reductions < minReductions || result.size() > maxResultSize) {
+        return;
+    }
+
+    if (file.is_open()) {
+        const std::string &fingerprint = fingerprintOf(query);
+        std::string key = fingerprint + '\t' + query.text;
+        if (persisted.emplace(key, result).second) {
+            file << key << '\t' << result << '\n';
+            fileSize += key.size() + result.size() + 2;
+            written.push_back(std::move(key));
+            if (fileSize > 2 * maxFileSize) {
+                compactFile();
+            }
+        }
+    }
+    callsOf(query);
+    insert(std::move(query.text), std::move(query.calls), result);
+}
+
+void QueryCache::insert(std::string&& text, std::set<FunctionKey>&& calls, const std::string& result) {
+    if (entries.size() >= capacity) {
+        entries.erase(ages.front());
+        ages.pop_front();
+    }
+
+    const auto inserted = entries.try_emplace(std::move(text));
+    Entry &entry = inserted.first->second;
+    entry.result = result;
+    if (inserted.second) {
+        entry.calls = std::move(calls);
+        ages.push_back(inserted.first->first);
+        entry.age = std::prev(ages.end());
+    }
+}
+
+void QueryCache::definitionChanged(const FunctionKey& key) {
+    sources.erase(key);
+    if (entries.empty()) {
+        return;
+    }
+
+    std::set<FunctionKey> affected = globalScope.dependentsOf(key);
+    affected.insert(key);
+
+    for (auto it = entries.begin(); it != entries.end();) {
+        bool stale = false;
+        for (auto call = it->second.calls.begin(); !stale && call != it->second.calls.end(); ++call) {
+            stale = affected.count(*call) != 0;
+        }
+
+        if (stale) {
+            ages.erase(it->second.age);
+            it = entries.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
+const std::set<FunctionKey>& QueryCache::callsOf(Query& query) {
+    if (query.calls.empty()) {
+        collectCalls(query.ast, query.calls);
+    }
+    return query.calls;
+}
+
+// FNV-1a over the normalized sources of everything the query reaches, in
+// key order.
+const std::string& QueryCache::fingerprintOf(Query& query) {
+    if (!query.fingerprint.empty()) {
+        return query.fingerprint;
+    }
+
+    std::set<FunctionKey> reached;
+    const std::set<FunctionKey> &calls = callsOf(query);
+    std::vector<FunctionKey> pending(calls.begin(), calls.end());
+    while (!pending.empty()) {
+        const FunctionKey key = pending.back();
+        pending.pop_back();
+
+        if (reached.insert(key).second) {
+            const Source &source = sourceOf(key);
+            pending.insert(pending.end(), source.calls.begin(), source.calls.end());
+        }
+    }
+
+    uint64_t hash = 14695981039346656037ull;
+    auto mix = [&hash](const std::string& text) {
+        for (const char ch : text) {
+            hash = (hash ^ static_cast<unsigned char>(ch)) * 1099511628211ull;
+        }
+    };
+    for (const FunctionKey &key : reached) {
+        mix(key.first + '/' + std::to_string(key.second) + '=');
+        mix(sourceOf(key).text);
+        mix(";");
+    }
+
+    static const char digits[] = "0123456789abcdef";
+    query.fingerprint.resize(16);
+    for (int i = 15; i >= 0; --i, hash >>= 4) {
+        query.fingerprint[i] = digits[hash & 0xf];
+    }
+    return query.fingerprint;
+}
+
+const QueryCache::Source& QueryCache::sourceOf(const FunctionKey& key) {
+    const auto it = sources.find(key);
+    if (it != sources.end()) {
+        return it->second;
+    }
+
+    Source &source = sources[key];
+    const Ref<FunctionDefinition> def = globalScope.findSource(key.first, key.second);
+    if (def) {
+        bool pure = true;
+        normalize(*def->definition, source.text, pure);
+        collectCalls(def->definition, source.calls);
+    }
+    else {
+        source.text = "?";
+    }
+    return source;
+}
\ No newline at end of file
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <fstream>
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "interpreter.hpp"
+
+struct Node;
+
+// Printed results of top-level queries. A query is keyed by its normalized
+// form: the parsed AST written back without whitespace and with literals in
+// canonical spelling, so "add( 1,+2 )" and "add(1, 2)" share an entry. An
+// entry is dropped as soon as a function the query reaches through the call
+// graph is redefined. Only queries that succeed and take at least
+// minReductions calls are cached; cheaper ones are faster to recompute than to
+// store. Queries containing definitions are never cached.
+//
+// Results may also be kept in a file across runs. There the key also holds a
+// fingerprint of the source text of every function the query reaches, since
+// the next run may define them differently. The file only keeps the newest
+// results that fit in maxFileSize: it is compacted to them when attached and
+// whenever appending makes it twice as large.
+class QueryCache : public DefinitionObserver {
+public:
+    static constexpr size_t defaultCapacity = 1 << 12;
+    static constexpr uint64_t minReductions = 16;
+    // Longer results are recomputed rather than kept.
+    static constexpr size_t maxResultSize = 1 << 16;
+    static constexpr size_t maxFileSize = 1 << 26;
+
+    struct Query {
+        Ref<Node> ast;
+        std::string text;
+        // Both filled in on first use.
+        std::set<FunctionKey> calls;
+        std::string fingerprint;
+    };
+
+    explicit QueryCache(GlobalScope& globalScope, size_t capacity = defaultCapacity);
+    ~QueryCache();
+
+    QueryCache(const QueryCache&) = delete;
+    QueryCache& operator=(const QueryCache&) = delete;
+
+    // Loads the results stored in `path` by earlier runs and appends new
+    // ones to it.
+    void attachFile(const std::string& path);
+
+    // False if `ast` may not be cached.
+    bool prepare(const Ref<Node>& ast, Query& query) const;
+
+    // The printed result of `query`, or null.
+    const std::string* find(Query& query);
+    // `reductions` is what computing the result took.
+    void store(Query& query, const std::string& result, uint64_t reductions);
+
+    void definitionChanged(const FunctionKey& key) override;
+
+    size_t getHits() const { return hits; }
+    size_t getMisses() const { return misses; }
+
+private:
+    struct Entry {
+        std::string result;
+        std::set<FunctionKey> calls;
+        std::list<std::string>::iterator age;
+    };
+
+    struct Source {
+        std::string text;
+        std::set<FunctionKey> calls;
+    };
+
+    static const std::set<FunctionKey>& callsOf(Query& query);
+    const std::string& fingerprintOf(Query& query);
+    const Source& sourceOf(const FunctionKey& key);
+    void insert(std::string&& text, std::set<FunctionKey>&& calls, const std::string& result);
+    void compactFile();
+
+    GlobalScope& globalScope;
+    size_t capacity;
+    std::unordered_map<std::string, Entry> entries;
+    // Oldest first; the front is evicted when the cache is full.
+    std::list<std::string> ages;
+
+    // Keyed by fingerprint and query text; `written` holds the keys in the
+    // order their lines were written, oldest first, and may repeat a key
+    // the file holds more than once.
+    std::unordered_map<std::string, std::string> persisted;
+    std::vector<std::string> written;
+    std::string path;
+    std::ofstream file;
+    size_t fileSize = 0;
+    // Normalized source of each function, for fingerprints.
+    std::map<FunctionKey, Source> sources;
+
+    size_t hits = 0;
+    size_t misses = 0;
+};
\ No newline at end of file
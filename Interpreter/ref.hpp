@@ -0,0 +1,120 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+// The evaluator is single-threaded, so reference counts are plain integers
+// unless THISFUNC_ATOMIC_REFCOUNT is set at build time.
+#ifndef THISFUNC_ATOMIC_REFCOUNT
+#define THISFUNC_ATOMIC_REFCOUNT 0
+#endif
+
+template<bool Atomic>
+struct BasicRefCounted {
+    BasicRefCounted() = default;
+    BasicRefCounted(const BasicRefCounted&) {}
+    BasicRefCounted& operator=(const BasicRefCounted&) { return *this; }
+    virtual ~BasicRefCounted() = default;
+
+    void retain() const noexcept {
+        if constexpr (Atomic) {
+            refCount.fetch_add(1, std::memory_order_relaxed);
+        }
+        else {
+            ++refCount;
+        }
+    }
+
+    bool release() const noexcept {
+        if constexpr (Atomic) {
+            return refCount.fetch_sub(1, std::memory_order_acq_rel) == 1;
+        }
+        else {
+            return --refCount == 0;
+        }
+    }
+
+    size_t useCount() const noexcept {
+        if constexpr (Atomic) {
+            return refCount.load(std::memory_order_relaxed);
+        }
+        else {
+            return refCount;
+        }
+    }
+
+private:
+    mutable std::conditional_t<Atomic, std::atomic<size_t>, size_t> refCount{0};
+};
+
+using RefCounted = BasicRefCounted<THISFUNC_ATOMIC_REFCOUNT != 0>;
+
+// For objects that may be shared between threads, such as the AST of a
+// library loaded once by the server. Evaluation never copies references to
+// these, so the atomic count is only paid when definitions are built.
+using SharedRefCounted = BasicRefCounted<true>;
+
+template<class T>
+class Ref {
+public:
+    Ref() noexcept : ptr(nullptr) {}
+    Ref(std::nullptr_t) noexcept : ptr(nullptr) {}
+
+    explicit Ref(T* ptr) noexcept : ptr(ptr) {
+        if (ptr) {
+            ptr->retain();
+        }
+    }
+
+    Ref(const Ref& other) noexcept : Ref(other.ptr) {}
+
+    Ref(Ref&& other) noexcept : ptr(other.ptr) {
+        other.ptr = nullptr;
+    }
+
+    template<class U>
+    Ref(const Ref<U>& other) noexcept : Ref(other.get()) {}
+
+    template<class U>
+    Ref(Ref<U>&& other) noexcept : ptr(other.detach()) {}
+
+    ~Ref() {
+        if (ptr && ptr->release()) {
+            delete ptr;
+        }
+    }
+
+    Ref& operator=(Ref other) noexcept {
+        std::swap(ptr, other.ptr);
+        return *this;
+    }
+
+    T* get() const noexcept { return ptr; }
+    T* operator->() const noexcept { return ptr; }
+    T& operator*() const noexcept { return *ptr; }
+    explicit operator bool() const noexcept { return ptr != nullptr; }
+
+    // Hands the reference over to the caller without touching the count.
+    T* detach() noexcept {
+        T* res = ptr;
+        ptr = nullptr;
+        return res;
+    }
+
+    template<class U>
+    bool operator==(const Ref<U>& other) const noexcept { return ptr == other.get(); }
+    template<class U>
+    bool operator!=(const Ref<U>& other) const noexcept { return ptr != other.get(); }
+    bool operator==(std::nullptr_t) const noexcept { return ptr == nullptr; }
+    bool operator!=(std::nullptr_t) const noexcept { return ptr != nullptr; }
+
+private:
+    T* ptr;
+};
+
+template<class T, class... Args>
+Ref<T> makeRef(Args&&... args) {
+    return Ref<T>(new T(std::forward<Args>(args)...));
+}
@@ -1,65 +1,229 @@
 #pragma once
 
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <functional>
 #include <string>
 #include <vector>
-#include <memory>
 #include <stdexcept>
 
-struct Value {
+#include "bigInt.hpp"
+#include "evaluation.hpp"
+#include "memory.hpp"
+#include "ref.hpp"
+
+struct Value : public RefCounted {
     enum class Type {
         REAL_NUMBER,
         INT_NUMBER,
+        BIG_INT_NUMBER,
         LIST_LITERAL,
+        SEQUENCE,
     };
 
     Type type;
+    // Structural hash, cached at construction. A singleton list hashes like
+    // its element, so eq() holding implies equal hashes for exact values.
+    size_t hash = 0;
+    // False when a real number occurs anywhere inside: reals compare with a
+    // tolerance, so their hashes cannot rule out equality.
+    bool exact = true;
+    // Set while the value is registered in the ValueTable.
+    bool interned = false;
 
     Value(Type type) : type(type) {}
+    ~Value();
+
+    // Appends the printed form to `out`. Nested values format into the same
+    // string, so printing a value is linear in the size of its output.
+    virtual void format(std::string& out) const = 0;
+
+    std::string toString() const {
+        std::string out;
+        format(out);
+        return out;
+    }
 
-    virtual std::string toString() const = 0;
+    // Factories for host code; they go through the same interning as the
+    // evaluator (see valueTable.hpp).
+    static Ref<Value> integer(int64_t value);
+    static Ref<Value> integer(const BigInt& value);
+    static Ref<Value> real(double value);
+    static Ref<Value> list(const std::vector<Ref<Value>> &values);
+
+    template<class T>
+    T* as() { return type == T::valueType ? static_cast<T*>(this) : nullptr; }
+
+    template<class T>
+    const T* as() const { return type == T::valueType ? static_cast<const T*>(this) : nullptr; }
 
 };
 
-struct RealValue : public Value {
+struct RealValue : public Value, public TrackedAllocation<MemoryKind::REAL> {
+    static constexpr Type valueType = Type::REAL_NUMBER;
+
     const double value;
 
-    RealValue(double value) : Value(Type::REAL_NUMBER), value(value) {}
+    RealValue(double value) : Value(Type::REAL_NUMBER), value(value) {
+        hash = std::hash<double>()(value);
+        exact = false;
+    }
 
-    std::string toString() const
-    {
-        return std::to_string(value);
+    // Shortest representation that reads back as the same double, with a
+    // ".0" kept on integral values so they still print as reals.
+    void format(std::string& out) const {
+        char buffer[32];
+        char* end = std::to_chars(buffer, buffer + sizeof(buffer), value).ptr;
+
+        out.append(buffer, end);
+        if (std::char_traits<char>::find(buffer, end - buffer, '.') == nullptr &&
+            std::char_traits<char>::find(buffer, end - buffer, 'e') == nullptr &&
+            std::isfinite(value)) {
+            out += ".0";
+        }
     }
 
 };
 
-struct IntValue : public Value {
-    const int value;
+struct IntValue : public Value, public TrackedAllocation<MemoryKind::INT> {
+    static constexpr Type valueType = Type::INT_NUMBER;
 
-    IntValue(int value) : Value(Type::INT_NUMBER), value(value) {}
+    const int64_t value;
 
-    std::string toString() const {
-        return std::to_string(value);
+    IntValue(int64_t value) : Value(Type::INT_NUMBER), value(value) {
+        hash = std::hash<int64_t>()(value);
+    }
+
+    void format(std::string& out) const {
+        char buffer[24];
+        out.append(buffer, std::to_chars(buffer, buffer + sizeof(buffer), value).ptr);
+    }
+
+};
+
+// An integer outside the int64 range. Integers are normalized: a value that
+// fits in int64 is always an IntValue, so the two never compare equal.
+struct BigIntValue : public Value, public TrackedAllocation<MemoryKind::BIG_INT> {
+    static constexpr Type valueType = Type::BIG_INT_NUMBER;
+
+    const BigInt value;
+
+    BigIntValue(const BigInt& value) : Value(Type::BIG_INT_NUMBER), value(value) {
+        hash = value.hash();
+        chargeBuffer(this->value.byteSize(), MemoryKind::BIG_INT);
+    }
+
+    ~BigIntValue() {
+        releaseBuffer(value.byteSize(), MemoryKind::BIG_INT);
+    }
+
+    void format(std::string& out) const {
+        out += value.toString();
     }
 
 };
 
-struct ListLiteralValue : public Value {
-    std::vector<std::shared_ptr<Value>> values;
+struct ListLiteralValue : public Value, public TrackedAllocation<MemoryKind::LIST> {
+    static constexpr Type valueType = Type::LIST_LITERAL;
+
+    std::vector<Ref<Value>> values;
 
-    ListLiteralValue(const std::vector<std::shared_ptr<Value>> &values) : Value(Value::Type::LIST_LITERAL), values(values) {
+    ListLiteralValue(const std::vector<Ref<Value>> &values) : Value(Value::Type::LIST_LITERAL), values(values) {
         if (type != Value::Type::LIST_LITERAL) {
             throw std::runtime_error("Invalid type for ListValue");
         }
+        chargeBuffer(bufferSize(), MemoryKind::LIST);
+
+        for (const Ref<Value> &val : values) {
+            mixIn(*val);
+        }
+        finishHash();
     }
 
-    std::string toString() const {
-        std::string result = "[";
+    ~ListLiteralValue() {
+        releaseBuffer(bufferSize(), MemoryKind::LIST);
+    }
+
+    size_t bufferSize() const { return values.capacity() * sizeof(Ref<Value>); }
+
+    // Appends in place, for lists nothing else can observe (see appendFunc()).
+    // The list must not be interned, since its hash changes.
+    void push(Ref<Value> val) {
+        if (values.size() == values.capacity()) {
+            const size_t capacity = std::max<size_t>(2 * values.capacity(), 1);
+            chargeBuffer((capacity - values.capacity()) * sizeof(Ref<Value>), MemoryKind::LIST);
+            values.reserve(capacity);
+        }
+        mixIn(*val);
+        values.push_back(std::move(val));
+        finishHash();
+    }
+
+    void format(std::string& out) const {
+        out += '[';
         for (size_t i = 0; i < values.size(); ++i) {
-            result += values[i]->toString();
-            if (i < values.size() - 1) result += ", ";
+            chargeEvalWork(1);
+            values[i]->format(out);
+            if (i < values.size() - 1) out += ", ";
         }
-        result += "]";
+        out += ']';
+    }
 
-        return result;
+private:
+    // Hash of the elements without the length, so push() only mixes in the
+    // new element.
+    size_t elementHash = 0x9e3779b97f4a7c15ULL;
+
+    void mixIn(const Value& val) {
+        elementHash ^= val.hash + 0x9e3779b97f4a7c15ULL + (elementHash << 6) + (elementHash >> 2);
+        exact = exact && val.exact;
+    }
+
+    void finishHash() {
+        hash = values.size() == 1 ? values[0]->hash : elementHash ^ values.size();
     }
 };
+
+// A list whose elements are produced on demand: either a window of a
+// materialized list or an arithmetic progression, possibly unbounded.
+// tail() and take() only move the window, so chains of them fuse into one
+// sequence and nothing is materialized until the elements are read.
+struct SequenceValue : public Value, public TrackedAllocation<MemoryKind::SEQUENCE> {
+    static constexpr Type valueType = Type::SEQUENCE;
+
+    // Elements [offset, offset + count) of a ListLiteralValue.
+    SequenceValue(const Ref<Value>& list, uint64_t offset, uint64_t count);
+    // start, start + step, start + 2 * step, ... without an end.
+    SequenceValue(const Ref<Value>& start, const Ref<Value>& step);
+
+    // Elements [offset, offset + count) of a ListLiteralValue, as a view, or
+    // copied out once they are a small part of the list, so that a short
+    // tail does not keep a long list alive.
+    static Ref<Value> window(const Ref<Value>& list, uint64_t offset, uint64_t count);
+
+    bool isBounded() const { return bounded; }
+    // Only meaningful for bounded sequences.
+    uint64_t size() const { return count; }
+    bool isEmpty() const { return bounded && count == 0; }
+
+    Ref<Value> at(uint64_t idx) const;
+    Ref<Value> drop(uint64_t n) const;
+    Ref<Value> take(uint64_t n) const;
+
+    // Unbounded sequences print their first elements followed by "...".
+    void format(std::string& out) const;
+
+private:
+    static constexpr uint64_t printedPrefix = 10;
+    // A window of less than 1/windowShare of its list is copied out. Repeated
+    // tail() calls then copy each element a constant number of times.
+    static constexpr uint64_t windowShare = 4;
+
+    Ref<Value> list;
+    Ref<Value> start, step;
+    uint64_t offset = 0;
+    uint64_t count = 0;
+    bool bounded = true;
+};
\ No newline at end of file
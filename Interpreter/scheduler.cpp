@@ -0,0 +1,196 @@
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <queue>
+#include <stdexcept>
+#include <thread>
+
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#include "evaluation.hpp"
+#include "scheduler.hpp"
+
+namespace {
+
+// Evaluations on a fiber may recurse as deeply as on a thread of their own.
+// Stack pages are only committed once touched.
+constexpr size_t fiberStackSize = 8 << 20;
+// Stacks a worker keeps for its next fibers instead of unmapping them.
+constexpr size_t pooledStacks = 16;
+
+size_t pageSize() {
+    static const size_t size = sysconf(_SC_PAGESIZE);
+    return size;
+}
+
+// The lowest page of the mapping is left inaccessible, so overrunning the
+// stack faults instead of overwriting another one.
+char* mapStack() {
+    void *mapping = mmap(nullptr, fiberStackSize + pageSize(), PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+    if (mapping == MAP_FAILED) {
+        throw std::runtime_error("Could not allocate a fiber stack");
+    }
+    mprotect(mapping, pageSize(), PROT_NONE);
+    return static_cast<char*>(mapping) + pageSize();
+}
+
+void unmapStack(char* stack) {
+    munmap(stack - pageSize(), fiberStackSize + pageSize());
+}
+
+}
+
+struct Scheduler::Fiber {
+    std::function<void()> task;
+    int priority;
+    // Slices the fiber has run for so far.
+    uint64_t slices = 0;
+    ucontext_t context{};
+    char* stack = nullptr;
+    // What EvalContext::current() was when the fiber last yielded.
+    EvalContext* evalContext = nullptr;
+    bool finished = false;
+};
+
+struct Scheduler::Worker {
+    // Within a priority, the fiber that has run for the fewest slices goes
+    // first, and among those the one queued first.
+    struct Entry {
+        int priority;
+        uint64_t slices;
+        uint64_t order;
+        Fiber* fiber;
+
+        bool operator<(const Entry& other) const {
+            if (priority != other.priority) {
+                return priority < other.priority;
+            }
+            return slices != other.slices ? slices > other.slices : order > other.order;
+        }
+    };
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::priority_queue<Entry> ready;
+    uint64_t order = 0;
+    bool stopping = false;
+
+    // Only touched by the worker's own thread.
+    ucontext_t context;
+    Fiber* running = nullptr;
+    std::vector<char*> stacks;
+
+    std::thread thread;
+};
+
+Scheduler::Worker*& Scheduler::currentWorker() {
+    thread_local Worker* worker = nullptr;
+    return worker;
+}
+
+Scheduler::Scheduler(size_t workerCount, uint64_t sliceReductions) : sliceReductions(sliceReductions) {
+    for (size_t i = 0; i < std::max<size_t>(workerCount, 1); ++i) {
+        workers.push_back(std::make_unique<Worker>());
+    }
+    for (const std::unique_ptr<Worker> &worker : workers) {
+        worker->thread = std::thread(&Scheduler::work, this, std::ref(*worker));
+    }
+}
+
+Scheduler::~Scheduler() {
+    for (const std::unique_ptr<Worker> &worker : workers) {
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        worker->stopping = true;
+        worker->wake.notify_one();
+    }
+    for (const std::unique_ptr<Worker> &worker : workers) {
+        worker->thread.join();
+    }
+}
+
+void Scheduler::submit(size_t worker, int priority, std::function<void()> task) {
+    Fiber *fiber = new Fiber{std::move(task), priority};
+    Worker &target = *workers[worker];
+
+    std::lock_guard<std::mutex> lock(target.mutex);
+    target.ready.push({priority, 0, target.order++, fiber});
+    target.wake.notify_one();
+}
+
+// Returning resumes the worker through uc_link. A fiber never yields inside
+// a catch block, so the thread's exception state needs no switching.
+void Scheduler::fiberMain() {
+    Fiber &fiber = *currentWorker()->running;
+    try {
+        fiber.task();
+    } catch (...) {
+    }
+    fiber.finished = true;
+}
+
+void Scheduler::yield() {
+    Worker &worker = *currentWorker();
+    swapcontext(&worker.running->context, &worker.context);
+}
+
+void Scheduler::work(Worker& worker) {
+    currentWorker() = &worker;
+
+    while (true) {
+        Fiber *fiber;
+        {
+            std::unique_lock<std::mutex> lock(worker.mutex);
+            worker.wake.wait(lock, [&worker] { return worker.stopping || !worker.ready.empty(); });
+            if (worker.ready.empty()) {
+                break;
+            }
+            fiber = worker.ready.top().fiber;
+            worker.ready.pop();
+        }
+
+        if (!fiber->stack) {
+            if (worker.stacks.empty()) {
+                fiber->stack = mapStack();
+            }
+            else {
+                fiber->stack = worker.stacks.back();
+                worker.stacks.pop_back();
+            }
+            getcontext(&fiber->context);
+            fiber->context.uc_stack.ss_sp = fiber->stack;
+            fiber->context.uc_stack.ss_size = fiberStackSize;
+            fiber->context.uc_link = &worker.context;
+            makecontext(&fiber->context, fiberMain, 0);
+        }
+
+        EvalContext::current() = fiber->evalContext;
+        EvalContext::timeSlice() = {yield, sliceReductions, reinterpret_cast<uintptr_t>(fiber->stack)};
+        worker.running = fiber;
+        swapcontext(&worker.context, &fiber->context);
+        worker.running = nullptr;
+        EvalContext::timeSlice() = {};
+        fiber->evalContext = EvalContext::current();
+        EvalContext::current() = nullptr;
+
+        if (!fiber->finished) {
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            worker.ready.push({fiber->priority, ++fiber->slices, worker.order++, fiber});
+            continue;
+        }
+
+        if (worker.stacks.size() < pooledStacks) {
+            worker.stacks.push_back(fiber->stack);
+        }
+        else {
+            unmapStack(fiber->stack);
+        }
+        delete fiber;
+    }
+
+    for (char *stack : worker.stacks) {
+        unmapStack(stack);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <vector>
+
+// Time-slices many evaluations over a fixed set of worker threads. Every
+// task runs on a fiber with a stack of its own, and evaluations on a fiber
+// hand their worker back every `sliceReductions` reductions (see TimeSlice
+// in evaluation.hpp). A short query therefore waits for at most one slice of
+// each long query on its worker instead of for the whole of it. Ready
+// fibers run highest priority first; within a priority, the one that has
+// had the fewest slices goes next, so new queries start right away and
+// long ones take turns.
+//
+// Values belong to the thread that made them (see valueTable.hpp), so a task
+// never leaves the worker it was queued on, and everything a session does,
+// from creating it to destroying it, has to be queued on the same worker.
+class Scheduler {
+public:
+    static constexpr uint64_t defaultSliceReductions = 1 << 13;
+
+    explicit Scheduler(size_t workerCount, uint64_t sliceReductions = defaultSliceReductions);
+    // Finishes every queued task first.
+    ~Scheduler();
+
+    Scheduler(const Scheduler&) = delete;
+    Scheduler& operator=(const Scheduler&) = delete;
+
+    // Spreads sessions over the workers.
+    size_t assignWorker() { return nextWorker++ % workers.size(); }
+
+    // `task` must not throw.
+    void submit(size_t worker, int priority, std::function<void()> task);
+
+    // Runs `task` on `worker` and waits for its result, or rethrows what it
+    // threw. Must not be called from a task.
+    template<class F>
+    auto run(size_t worker, int priority, F task) -> decltype(task()) {
+        std::packaged_task<decltype(task())()> packaged(std::move(task));
+        auto result = packaged.get_future();
+        submit(worker, priority, [&packaged] { packaged(); });
+        return result.get();
+    }
+
+private:
+    struct Fiber;
+    struct Worker;
+
+    // The worker running on this thread, if any.
+    static Worker*& currentWorker();
+    static void fiberMain();
+    static void yield();
+    void work(Worker& worker);
+
+    uint64_t sliceReductions;
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<size_t> nextWorker{0};
+};
\ No newline at end of file
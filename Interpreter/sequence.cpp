@@ -0,0 +1,84 @@
+#include <algorithm>
+
+#include "builtins.hpp"
+#include "valueTable.hpp"
+
+SequenceValue::SequenceValue(const Ref<Value>& list, uint64_t offset, uint64_t count)
+: Value(Type::SEQUENCE), list(list), offset(offset), count(count) {
+    // Elements are not known up front, so hashes cannot rule out equality.
+    exact = false;
+}
+
+SequenceValue::SequenceValue(const Ref<Value>& start, const Ref<Value>& step)
+: Value(Type::SEQUENCE), start(start), step(step), bounded(false) {
+    exact = false;
+}
+
+Ref<Value> SequenceValue::window(const Ref<Value>& list, uint64_t offset, uint64_t count) {
+    const std::vector<Ref<Value>> &values = list->as<ListLiteralValue>()->values;
+    if (count >= values.size() / windowShare) {
+        return makeRef<SequenceValue>(list, offset, count);
+    }
+    return makeList(std::vector<Ref<Value>>(values.begin() + offset, values.begin() + offset + count));
+}
+
+Ref<Value> SequenceValue::at(uint64_t idx) const {
+    if (bounded && idx >= count) {
+        throw std::runtime_error("Sequence index out of range");
+    }
+
+    const uint64_t pos = offset + idx;
+    if (list) {
+        return list->as<ListLiteralValue>()->values[pos];
+    }
+
+    if (start->type == Type::REAL_NUMBER || step->type == Type::REAL_NUMBER) {
+        return makeReal(toDouble(*start) + double(pos) * toDouble(*step));
+    }
+
+    int64_t scaled, res;
+    if (start->type == Type::INT_NUMBER && step->type == Type::INT_NUMBER && pos <= uint64_t(INT64_MAX) &&
+        !__builtin_mul_overflow(int64_t(pos), step->as<IntValue>()->value, &scaled) &&
+        !__builtin_add_overflow(start->as<IntValue>()->value, scaled, &res)) {
+        return makeInt(res);
+    }
+    return makeInteger(toBigInt(*start) + BigInt(int64_t(pos)) * toBigInt(*step));
+}
+
+Ref<Value> SequenceValue::drop(uint64_t n) const {
+    if (list) {
+        n = std::min(n, count);
+        return window(list, offset + n, count - n);
+    }
+
+    Ref<SequenceValue> res = makeRef<SequenceValue>(*this);
+    if (bounded) {
+        n = std::min(n, count);
+        res->count -= n;
+    }
+    res->offset += n;
+    return res;
+}
+
+Ref<Value> SequenceValue::take(uint64_t n) const {
+    if (list) {
+        return window(list, offset, std::min(n, count));
+    }
+
+    Ref<SequenceValue> res = makeRef<SequenceValue>(*this);
+    res->count = bounded ? std::min(n, count) : n;
+    res->bounded = true;
+    return res;
+}
+
+void SequenceValue::format(std::string& out) const {
+    const uint64_t printed = bounded ? count : printedPrefix;
+
+    out += '[';
+    for (uint64_t i = 0; i < printed; ++i) {
+        chargeEvalWork(1);
+        at(i)->format(out);
+        if (i + 1 < printed) out += ", ";
+    }
+    out += bounded ? "]" : ", ...]";
+}
\ No newline at end of file
@@ -0,0 +1,284 @@
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "server.hpp"
+
+namespace {
+
+volatile std::sig_atomic_t stopRequested = 0;
+
+void requestStop(int) {
+    stopRequested = 1;
+}
+
+double processCpuSeconds() {
+    timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+bool sendLine(int fd, std::string line) {
+    line += '\n';
+    size_t sent = 0;
+
+    while (sent < line.size()) {
+        ssize_t n = send(fd, line.data() + sent, line.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        sent += n;
+    }
+    return true;
+}
+
+// ":priority N"; false for any other line.
+bool parsePriority(const std::string& line, int& priority, std::string& response) {
+    static const std::string command = ":priority ";
+    if (line.compare(0, command.size(), command) != 0) {
+        return false;
+    }
+
+    char *end;
+    errno = 0;
+    const long value = std::strtol(line.c_str() + command.size(), &end, 10);
+    if (end == line.c_str() + command.size() || *end != '\0' || errno == ERANGE || value < INT_MIN || value > INT_MAX) {
+        response = "err Invalid priority";
+    }
+    else {
+        priority = static_cast<int>(value);
+        response = "ok";
+    }
+    return true;
+}
+
+std::string singleLine(std::string text) {
+    while (!text.empty() && text.back() == '\n') {
+        text.pop_back();
+    }
+    std::replace(text.begin(), text.end(), '\n', ' ');
+    return text;
+}
+
+}
+
+Server::Server(const std::string& socketPath, const char* libraryPath, const EvalBudget& budget)
+: socketPath(socketPath), budget(budget), scheduler(std::thread::hardware_concurrency()) {
+    this->budget.cancelFlag = &cancelAll;
+
+    if (libraryPath) {
+        std::ifstream file(libraryPath);
+        if (!file.is_open()) {
+            throw std::runtime_error("Problem while opening file!");
+        }
+
+        std::string line;
+        while (std::getline(file, line)) {
+            if (line == "exit") {
+                break;
+            }
+            if (line.empty() || line[0] == '#') {
+                continue;
+            }
+
+            try {
+                library.evaluate(line);
+            } catch (const std::runtime_error &loadException) {
+                std::cerr << line << '\n' << loadException.what() << std::endl;
+            }
+        }
+    }
+    latencies.reserve(latencyWindow);
+}
+
+Server::~Server() {
+    if (listenFd >= 0) {
+        close(listenFd);
+        unlink(socketPath.c_str());
+    }
+}
+
+int Server::serve() {
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(addr.sun_path)) {
+        throw std::runtime_error("Socket path is too long");
+    }
+    std::strcpy(addr.sun_path, socketPath.c_str());
+
+    listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    unlink(socketPath.c_str());
+    if (listenFd < 0 || bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(listenFd, 128) < 0) {
+        throw std::runtime_error("Could not listen on " + socketPath);
+    }
+
+    std::signal(SIGINT, requestStop);
+    std::signal(SIGTERM, requestStop);
+
+    startWall = std::chrono::steady_clock::now();
+    startCpuSeconds = processCpuSeconds();
+    std::cout << "Listening on " << socketPath << std::endl;
+
+    while (!stopRequested) {
+        pollfd pfd = {listenFd, POLLIN, 0};
+        if (poll(&pfd, 1, 200) <= 0) {
+            continue;
+        }
+
+        int clientFd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (clientFd < 0) {
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(sessionsMutex);
+        clientFds.insert(clientFd);
+        std::thread(&Server::serveSession, this, clientFd).detach();
+    }
+
+    cancelAll = true;
+    {
+        std::unique_lock<std::mutex> lock(sessionsMutex);
+        for (int fd : clientFds) {
+            shutdown(fd, SHUT_RDWR);
+        }
+        sessionsDone.wait(lock, [this] { return clientFds.empty(); });
+    }
+
+    std::cerr << statsLine() << std::endl;
+    return 0;
+}
+
+void Server::serveSession(int clientFd) {
+    // The session is only ever touched on its worker, see scheduler.hpp.
+    const size_t worker = scheduler.assignWorker();
+    std::unique_ptr<ListFunc> session;
+    scheduler.run(worker, 0, [this, &session] {
+        session = std::make_unique<ListFunc>(&library.getGlobalScope());
+        session->setBudget(budget);
+    });
+
+    int priority = 0;
+    std::string pending;
+    char buffer[4096];
+    bool open = true;
+
+    while (open) {
+        ssize_t n = read(clientFd, buffer, sizeof(buffer));
+        if (n <= 0) {
+            break;
+        }
+        pending.append(buffer, n);
+        const auto received = std::chrono::steady_clock::now();
+
+        size_t newline;
+        while (open && (newline = pending.find('\n')) != std::string::npos) {
+            std::string line = pending.substr(0, newline);
+            pending.erase(0, newline + 1);
+
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            if (line == ":quit") {
+                open = false;
+                break;
+            }
+
+            std::string response;
+            if (!parsePriority(line, priority, response)) {
+                response = scheduler.run(worker, priority, [this, &session, &line, received] { return handleRequest(*session, line, received); });
+            }
+            open = sendLine(clientFd, response);
+        }
+    }
+
+    scheduler.run(worker, 0, [&session] { session.reset(); });
+    close(clientFd);
+    std::lock_guard<std::mutex> lock(sessionsMutex);
+    clientFds.erase(clientFd);
+    sessionsDone.notify_all();
+}
+
+std::string Server::handleRequest(ListFunc& session, const std::string& line, std::chrono::steady_clock::time_point received) {
+    if (line == ":stats") {
+        return "ok " + statsLine();
+    }
+    if (line == ":mem") {
+        return "ok " + session.memoryReport();
+    }
+    if (line.empty() || line[0] == '#') {
+        return "ok";
+    }
+
+    std::string response;
+
+    try {
+        std::string printed;
+        response = session.evaluate(line, &printed) ? "ok " + printed : "ok";
+    } catch (const std::runtime_error &execException) {
+        response = "err " + singleLine(execException.what());
+    }
+
+    recordLatency(std::chrono::steady_clock::now() - received);
+    return response;
+}
+
+void Server::recordLatency(std::chrono::nanoseconds elapsed) {
+    const uint32_t micros = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+
+    std::lock_guard<std::mutex> lock(statsMutex);
+    if (latencies.size() < latencyWindow) {
+        latencies.push_back(micros);
+    }
+    else {
+        latencies[totalQueries % latencyWindow] = micros;
+    }
+    ++totalQueries;
+}
+
+// Throughput per core is queries per second of process CPU time, i.e. what
+// one fully busy core sustains regardless of how many sessions are open.
+std::string Server::statsLine() {
+    std::vector<uint32_t> sample;
+    uint64_t queries;
+    {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        sample = latencies;
+        queries = totalQueries;
+    }
+
+    auto percentile = [&sample](double p) -> uint32_t {
+        if (sample.empty()) {
+            return 0;
+        }
+        const size_t idx = std::min(sample.size() - 1, static_cast<size_t>(p * sample.size()));
+        std::nth_element(sample.begin(), sample.begin() + idx, sample.end());
+        return sample[idx];
+    };
+
+    const double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startWall).count();
+    const double cpuSeconds = processCpuSeconds() - startCpuSeconds;
+
+    std::ostringstream out;
+    out << "queries=" << queries
+        << " p50_us=" << percentile(0.50)
+        << " p99_us=" << percentile(0.99)
+        << " qps=" << (wallSeconds > 0 ? queries / wallSeconds : 0)
+        << " qps_per_core=" << (cpuSeconds > 0 ? queries / cpuSeconds : 0)
+        << " live_bytes=" << memoryStats().total().liveBytes;
+    return out.str();
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "scheduler.hpp"
+#include "thisFuncSingleton.hpp"
+
+// Long-running daemon serving interpreter sessions over a Unix domain socket.
+//
+// Protocol: the client sends one ThisFunc line per request and gets exactly
+// one line back, "ok" or "ok <value>" on success and "err <message>" on
+// failure. ":stats" returns the server's latency and throughput counters,
+// ":mem" the memory accounting (see memory.hpp), ":priority N" sets the
+// priority of the session's later queries (default 0, higher runs first) and
+// ":quit" ends the session.
+//
+// Library definitions are loaded once into a shared session that is never
+// modified afterwards. Each client gets its own session layered on top of it,
+// so its definitions are private scratch space. Queries of all sessions are
+// time-sliced over one worker thread per core, see scheduler.hpp.
+class Server {
+public:
+    Server(const std::string& socketPath, const char* libraryPath, const EvalBudget& budget);
+    ~Server();
+
+    Server(const Server& other) = delete;
+    Server& operator=(const Server& other) = delete;
+
+    int serve();
+
+private:
+    void serveSession(int clientFd);
+    // `received` is when the line was read, so the recorded latency
+    // includes the time the request waited for a worker.
+    std::string handleRequest(ListFunc& session, const std::string& line, std::chrono::steady_clock::time_point received);
+    void recordLatency(std::chrono::nanoseconds elapsed);
+    std::string statsLine();
+
+    std::string socketPath;
+    int listenFd = -1;
+    ListFunc library;
+
+    // Every query runs under this budget; shutting down raises the cancel
+    // flag so queries still running end promptly.
+    EvalBudget budget;
+    std::atomic<bool> cancelAll{false};
+
+    // Declared after the library, which the sessions running on it use.
+    Scheduler scheduler;
+
+    std::mutex sessionsMutex;
+    std::condition_variable sessionsDone;
+    std::set<int> clientFds;
+
+    // Ring of the most recent query latencies, in microseconds.
+    static constexpr size_t latencyWindow = 1 << 16;
+
+    std::mutex statsMutex;
+    std::vector<uint32_t> latencies;
+    uint64_t totalQueries = 0;
+    std::chrono::steady_clock::time_point startWall;
+    double startCpuSeconds = 0;
+};
@@ -0,0 +1,395 @@
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "thisFuncSingleton.hpp"
+
+// Sharded script runs. The parent parses the whole script and applies the
+// definitions; workers are forked from it, so they share the parsed lines and
+// the definitions copy-on-write and are only ever told line numbers.
+//
+// Parent -> worker: "q <line>\n" evaluates a query and answers it, "d <line>\n"
+// applies a definition silently. Worker -> parent, one per query:
+// "<line> <status> <length>\n<payload>", status being 'v' (a value), 'n' (no
+// value), 'r' (raw text) or 'e' (an error message).
+
+namespace {
+
+// Queries a worker may hold at once, so it never idles waiting for the parent
+// between two of them.
+constexpr size_t pipelineDepth = 2;
+
+struct ShardResult {
+    bool ready = false;
+    char status = 'n';
+    std::string text;
+};
+
+struct ShardWorker {
+    pid_t pid = -1;
+    int commandFd = -1;
+    int replyFd = -1;
+    // Lines assigned to this worker that were not sent yet, in source order.
+    std::deque<size_t> queue;
+    // Lines sent and not answered yet; the front one is being evaluated.
+    std::deque<size_t> inFlight;
+    std::string pending;
+};
+
+bool writeAll(int fd, const std::string& data) {
+    size_t written = 0;
+
+    while (written < data.size()) {
+        ssize_t n = write(fd, data.data() + written, data.size() - written);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        written += n;
+    }
+    return true;
+}
+
+std::string describeExit(int status) {
+    if (WIFSIGNALED(status)) {
+        return "signal " + std::to_string(WTERMSIG(status));
+    }
+    return "exit code " + std::to_string(WEXITSTATUS(status));
+}
+
+// An idle worker takes the later half of the longest queue, so the victim
+// keeps the lines it is about to need.
+bool steal(ShardWorker& thief, std::vector<ShardWorker>& workers) {
+    ShardWorker* victim = nullptr;
+    for (ShardWorker& worker : workers) {
+        if (&worker != &thief && (!victim || worker.queue.size() > victim->queue.size())) {
+            victim = &worker;
+        }
+    }
+    if (!victim || victim->queue.empty()) {
+        return false;
+    }
+
+    const size_t count = (victim->queue.size() + 1) / 2;
+    thief.queue.insert(thief.queue.end(), victim->queue.end() - count, victim->queue.end());
+    victim->queue.erase(victim->queue.end() - count, victim->queue.end());
+    return true;
+}
+
+// Consumes every complete reply in the worker's buffer.
+template<class OnReply>
+void parseReplies(ShardWorker& worker, OnReply onReply) {
+    while (true) {
+        const size_t newline = worker.pending.find('\n');
+        if (newline == std::string::npos) {
+            return;
+        }
+
+        size_t idx, length;
+        char status;
+        if (sscanf(worker.pending.c_str(), "%zu %c %zu", &idx, &status, &length) != 3) {
+            throw std::runtime_error("Malformed reply from a shard worker");
+        }
+        if (worker.pending.size() < newline + 1 + length) {
+            return;
+        }
+
+        onReply(idx, status, worker.pending.substr(newline + 1, length));
+        worker.pending.erase(0, newline + 1 + length);
+    }
+}
+
+}
+
+void ListFunc::serveShard(const std::vector<ShardLine>& lines, int commandFd, int replyFd) {
+    std::string pending;
+    char buffer[4096];
+
+    while (true) {
+        size_t newline;
+        while ((newline = pending.find('\n')) == std::string::npos) {
+            ssize_t n = read(commandFd, buffer, sizeof(buffer));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return;
+            }
+            pending.append(buffer, n);
+        }
+
+        const char op = pending[0];
+        const size_t idx = std::stoull(pending.substr(2, newline - 2));
+        pending.erase(0, newline + 1);
+
+        const ShardLine& line = lines[idx];
+        if (op == 'd') {
+            try {
+                evaluate(*line.ast);
+            } catch (const std::runtime_error &) {
+                // The parent applied the same definition and reports the error.
+            }
+            continue;
+        }
+
+        char status = 'v';
+        std::string payload;
+        if (!line.ast) {
+            status = 'r';
+            payload = memoryReport();
+        }
+        else {
+            try {
+                if (!evaluate(*line.ast, &payload)) {
+                    status = 'n';
+                }
+            } catch (const std::runtime_error &execException) {
+                status = 'e';
+                payload = execException.what();
+            }
+        }
+
+        if (!writeAll(replyFd, std::to_string(idx) + ' ' + status + ' ' + std::to_string(payload.size()) + '\n' + payload)) {
+            return;
+        }
+    }
+}
+
+int ListFunc::run(const char* path, size_t shards) {
+    if (shards <= 1) {
+        return run(path);
+    }
+
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        throw std::runtime_error("Problem while opening file!");
+    }
+
+    std::vector<ShardLine> lines;
+    std::string text;
+    while (std::getline(file, text) && text != "exit") {
+        if (text.empty() || text[0] == '#') {
+            continue;
+        }
+
+        ShardLine line = {text, nullptr, ""};
+        if (text != ":mem") {
+            try {
+                Lexer lexer(text);
+                std::vector<Token> tokens = lexer.lex();
+
+                Parser parser(tokens.begin());
+                line.ast = parser.parse(std::cout);
+            } catch (const std::runtime_error &parseException) {
+                line.error = parseException.what();
+            }
+        }
+        lines.push_back(std::move(line));
+    }
+
+    std::vector<ShardResult> results(lines.size());
+    std::vector<ShardWorker> workers(shards);
+    size_t printed = 0;
+
+    auto isQuery = [&lines](size_t idx) {
+        return lines[idx].error.empty() && !(lines[idx].ast && lines[idx].ast->as<FunctionDefinition>());
+    };
+
+    auto printReady = [&]() {
+        for (; printed < lines.size() && results[printed].ready; ++printed) {
+            const ShardResult& res = results[printed];
+
+            output << lines[printed].text << '\n';
+            if (res.status == 'v') {
+                output << ">> " << res.text << '\n';
+            }
+            else if (res.status == 'r') {
+                output << res.text << '\n';
+            }
+            else if (res.status == 'e') {
+                reportError(res.text);
+            }
+        }
+    };
+
+    // Forked from the parent as it is now, so a replacement worker starts
+    // with every definition applied so far.
+    auto spawn = [&](ShardWorker& worker) {
+        int commands[2], replies[2];
+        if (pipe(commands) != 0 || pipe(replies) != 0) {
+            throw std::runtime_error("Could not create pipes for a shard worker");
+        }
+
+        output.flush();
+        std::cerr.flush();
+        const pid_t pid = fork();
+        if (pid < 0) {
+            throw std::runtime_error("Could not fork a shard worker");
+        }
+        if (pid == 0) {
+            close(commands[1]);
+            close(replies[0]);
+            // Other workers' pipes must not stay open here, or their crashes
+            // would never show up as end of file in the parent.
+            for (const ShardWorker &other : workers) {
+                if (other.pid > 0) {
+                    close(other.commandFd);
+                    close(other.replyFd);
+                }
+            }
+            serveShard(lines, commands[0], replies[1]);
+            _exit(0);
+        }
+
+        close(commands[0]);
+        close(replies[1]);
+        worker.pid = pid;
+        worker.commandFd = commands[1];
+        worker.replyFd = replies[0];
+        worker.pending.clear();
+    };
+
+    auto reap = [](ShardWorker& worker) {
+        close(worker.commandFd);
+        close(worker.replyFd);
+
+        int status = 0;
+        waitpid(worker.pid, &status, 0);
+        worker.pid = -1;
+        return status;
+    };
+
+    // A dead worker only shows up when its reply pipe closes, so writes
+    // to it must fail instead of killing the parent.
+    struct sigaction ignorePipe = {}, previousPipe;
+    ignorePipe.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &ignorePipe, &previousPipe);
+
+    size_t pos = 0;
+    while (pos < lines.size()) {
+        if (!isQuery(pos)) {
+            ShardResult& res = results[pos];
+            res.ready = true;
+
+            if (!lines[pos].error.empty()) {
+                res.status = 'e';
+                res.text = lines[pos].error;
+            }
+            else {
+                try {
+                    evaluate(*lines[pos].ast);
+                } catch (const std::runtime_error &execException) {
+                    res.status = 'e';
+                    res.text = execException.what();
+                }
+                for (ShardWorker &worker : workers) {
+                    if (worker.pid > 0 && !writeAll(worker.commandFd, "d " + std::to_string(pos) + '\n')) {
+                        reap(worker);
+                    }
+                }
+            }
+            printReady();
+            ++pos;
+            continue;
+        }
+
+        // A run of queries between two definitions; they all see the same
+        // definitions, so any worker may answer any of them.
+        size_t end = pos;
+        while (end < lines.size() && isQuery(end)) {
+            ++end;
+        }
+
+        const size_t chunk = (end - pos + shards - 1) / shards;
+        for (size_t i = 0; i < shards; ++i) {
+            for (size_t idx = pos + i * chunk; idx < std::min(end, pos + (i + 1) * chunk); ++idx) {
+                workers[i].queue.push_back(idx);
+            }
+            if (workers[i].pid < 0) {
+                spawn(workers[i]);
+            }
+        }
+
+        size_t remaining = end - pos;
+        std::vector<pollfd> fds(shards);
+        char buffer[65536];
+
+        while (remaining > 0) {
+            for (ShardWorker &worker : workers) {
+                while (worker.inFlight.size() < pipelineDepth && (!worker.queue.empty() || steal(worker, workers))) {
+                    const size_t idx = worker.queue.front();
+                    worker.queue.pop_front();
+                    worker.inFlight.push_back(idx);
+                    writeAll(worker.commandFd, "q " + std::to_string(idx) + '\n');
+                }
+            }
+
+            for (size_t i = 0; i < shards; ++i) {
+                fds[i] = {workers[i].replyFd, POLLIN, 0};
+            }
+            if (poll(fds.data(), fds.size(), -1) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::runtime_error("Waiting for shard workers failed");
+            }
+
+            for (size_t i = 0; i < shards; ++i) {
+                if (!fds[i].revents) {
+                    continue;
+                }
+                ShardWorker& worker = workers[i];
+
+                ssize_t n = read(worker.replyFd, buffer, sizeof(buffer));
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n > 0) {
+                    worker.pending.append(buffer, n);
+                    parseReplies(worker, [&](size_t idx, char status, std::string payload) {
+                        results[idx] = {true, status, std::move(payload)};
+                        worker.inFlight.pop_front();
+                        --remaining;
+                    });
+                    continue;
+                }
+
+                // The worker died: the query it was evaluating fails, the
+                // ones queued behind it go back to the front of its queue.
+                const int status = reap(worker);
+                if (!worker.inFlight.empty()) {
+                    const size_t idx = worker.inFlight.front();
+                    worker.inFlight.pop_front();
+                    results[idx] = {true, 'e', "Worker crashed while evaluating this query (" + describeExit(status) + ")"};
+                    --remaining;
+                }
+                worker.queue.insert(worker.queue.begin(), worker.inFlight.begin(), worker.inFlight.end());
+                worker.inFlight.clear();
+                spawn(worker);
+            }
+            printReady();
+        }
+        pos = end;
+    }
+
+    for (ShardWorker &worker : workers) {
+        if (worker.pid > 0) {
+            reap(worker);
+        }
+    }
+    sigaction(SIGPIPE, &previousPipe, nullptr);
+
+    output.flush();
+    return 0;
+}
\ No newline at end of file
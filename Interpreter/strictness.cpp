@@ -0,0 +1,54 @@
+#include "parser.hpp"
+#include "strictness.hpp"
+
+uint64_t allArguments(size_t argc) {
+    return argc >= maxStrictArguments ? ~uint64_t(0) : (uint64_t(1) << argc) - 1;
+}
+
+uint64_t forcedArguments(const Ref<Node>& node, const GlobalScope& globalScope, const std::map<FunctionKey, uint64_t>& assumed) {
+    switch (node->kind) {
+    case Node::Kind::ARGUMENT:
+    {
+        const size_t idx = std::stoul(node->token.data);
+        return idx < maxStrictArguments ? uint64_t(1) << idx : 0;
+    }
+    case Node::Kind::LIST_LITERAL:
+    {
+        uint64_t forced = 0;
+        for (const Ref<Node> &item : node->as<ListLiteralNode>()->contents) {
+            forced |= forcedArguments(item, globalScope, assumed);
+        }
+        return forced;
+    }
+    case Node::Kind::FUNCTION_APPLICATION:
+    {
+        const std::vector<Ref<Node>> &args = node->as<FunctionApplication>()->arguments;
+        const FunctionKey callee(node->token.data, args.size());
+
+        uint64_t calleeMask = 0;
+        const auto known = assumed.find(callee);
+        if (known != assumed.end()) {
+            calleeMask = known->second;
+        }
+        else if (const FunctionDefinition *def = globalScope.findDefinition(callee.first, callee.second)) {
+            // if() forces its condition and whatever both branches force.
+            const DefaultFunctionNode *builtin = def->definition->as<DefaultFunctionNode>();
+            if (builtin && builtin->id == Builtin::IF) {
+                return forcedArguments(args[0], globalScope, assumed) |
+                       (forcedArguments(args[1], globalScope, assumed) & forcedArguments(args[2], globalScope, assumed));
+            }
+            calleeMask = def->strictArguments;
+        }
+
+        uint64_t forced = 0;
+        for (size_t i = 0; i < args.size() && i < maxStrictArguments; ++i) {
+            if ((calleeMask >> i) & 1) {
+                forced |= forcedArguments(args[i], globalScope, assumed);
+            }
+        }
+        return forced;
+    }
+    default:
+        return 0;
+    }
+}
\ No newline at end of file
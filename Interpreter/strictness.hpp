@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+
+#include "interpreter.hpp"
+
+struct Node;
+
+// Strictness analysis. A function is strict in #i if evaluating its body
+// always forces #i or does not terminate; a caller may then evaluate that
+// argument up front and pass the value. Masks hold bit i for #i, so only
+// the first 64 arguments of a function can be strict.
+constexpr size_t maxStrictArguments = 64;
+
+uint64_t allArguments(size_t argc);
+
+// Arguments of the enclosing function that evaluating `node` is sure to
+// force. Callees listed in `assumed` use that mask; any other callee uses
+// the mask of its current definition in `globalScope`, and undefined
+// callees force nothing.
+uint64_t forcedArguments(const Ref<Node>& node, const GlobalScope& globalScope, const std::map<FunctionKey, uint64_t>& assumed);
\ No newline at end of file
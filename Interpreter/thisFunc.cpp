@@ -0,0 +1,40 @@
+#include <stdexcept>
+
+#include "thisFunc.hpp"
+
+CompiledFunction::CompiledFunction(GlobalScope& globalScope, const EvalBudget& budget, const FunctionKey& key)
+: globalScope(&globalScope), budget(&budget), key(key), generation(globalScope.getGeneration()) {
+    const FunctionDefinition *def = globalScope.findDefinition(key.first, key.second);
+    if (!def) {
+        throw std::runtime_error("Called function which is not defined");
+    }
+    definition = Ref<const FunctionDefinition>(def);
+}
+
+const FunctionDefinition& CompiledFunction::resolve() const {
+    if (generation != globalScope->getGeneration()) {
+        const FunctionDefinition *def = globalScope->findDefinition(key.first, key.second);
+        if (!def) {
+            throw std::runtime_error("Called function which is not defined");
+        }
+        definition = Ref<const FunctionDefinition>(def);
+        generation = globalScope->getGeneration();
+    }
+    return *definition;
+}
+
+Ref<Value> CompiledFunction::call(const Ref<Value>* args, size_t count) const {
+    if (count != key.second) {
+        throw std::runtime_error("Wrong number of arguments for " + key.first);
+    }
+
+    EvalContext context(*budget);
+    EvalContextGuard guard(context);
+
+    FunctionScope scope(*globalScope, args, count);
+    return globalScope->callFunction(resolve(), scope);
+}
+
+CompiledFunction Interpreter::compile(const std::string& name, size_t argc) {
+    return CompiledFunction(session.getGlobalScope(), session.getBudget(), FunctionKey(name, argc));
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "thisFuncSingleton.hpp"
+
+class Interpreter;
+
+// A callable handle to one user function, resolved by name and arity.
+// Arguments are passed as values and never go through the lexer or parser;
+// the result is returned as a value. The handle re-resolves the function
+// only when its interpreter's definitions have changed since the last call.
+class CompiledFunction {
+public:
+    template<class... Args>
+    Ref<Value> operator()(const Args&... args) const {
+        const Ref<Value> argv[] = {Ref<Value>(args)..., nullptr};
+        return call(argv, sizeof...(Args));
+    }
+
+    Ref<Value> call(const std::vector<Ref<Value>>& args) const {
+        return call(args.data(), args.size());
+    }
+
+    Ref<Value> call(const Ref<Value>* args, size_t count) const;
+
+    const std::string& getName() const { return key.first; }
+    size_t getArgc() const { return key.second; }
+
+private:
+    friend class Interpreter;
+
+    CompiledFunction(GlobalScope& globalScope, const EvalBudget& budget, const FunctionKey& key);
+
+    const FunctionDefinition& resolve() const;
+
+    GlobalScope* globalScope;
+    const EvalBudget* budget;
+    FunctionKey key;
+    mutable Ref<const FunctionDefinition> definition;
+    mutable size_t generation;
+};
+
+// Embeddable interpreter. Unlike ListFunc::getInstance() it can be
+// instantiated any number of times, and instances share nothing except an
+// optional read-only library interpreter passed at construction. The library
+// must outlive every interpreter layered on it.
+//
+//     Interpreter interp;
+//     interp.evaluate("fact <- if(eq(#0, 0), 1, mul(#0, fact(sub(#0, 1))))");
+//     CompiledFunction fact = interp.compile("fact", 1);
+//     Ref<Value> res = fact(Value::integer(10));
+class Interpreter {
+public:
+    Interpreter() = default;
+    // A session over `library`: lookups that miss fall through to it, and it
+    // is never modified.
+    explicit Interpreter(const Interpreter* library) : session(&library->session.getGlobalScope()) {}
+
+    Interpreter(const Interpreter&) = delete;
+    Interpreter& operator=(const Interpreter&) = delete;
+
+    // Evaluates one line of ThisFunc; definitions yield a null value.
+    Ref<Value> evaluate(const std::string& line) { return session.evaluate(line); }
+
+    // Throws if no function `name` taking `argc` arguments is defined.
+    CompiledFunction compile(const std::string& name, size_t argc);
+
+    // Applies to evaluate() and to every call through a compiled handle.
+    void setBudget(const EvalBudget& budget) { session.setBudget(budget); }
+
+private:
+    ListFunc session;
+};
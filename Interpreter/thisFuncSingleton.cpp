@@ -1,35 +1,111 @@
+#include <algorithm>
 #include <fstream>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include "optimizer.hpp"
 #include "thisFuncSingleton.hpp"
 
+ListFunc::ListFunc() {
+    globalScope.loadDefaultLibrary();
+}
+
+ListFunc::ListFunc(const GlobalScope* library) : globalScope(library) {}
+
+Ref<Value> ListFunc::evaluate(const std::string& line, std::string* printed) {
+    return evaluate(*parse(line), printed);
+}
+
+Ref<Node> ListFunc::parse(const std::string& line) {
+    Lexer lexer(line);
+    std::vector<Token> tokens = lexer.lex();
+
+    Parser parser(tokens.begin());
+    return parser.parse(std::cout);
+}
+
+Ref<Value> ListFunc::evaluate(const Node& ast, std::string* printed) {
+    EvalContext context(budget);
+    EvalContextGuard guard(context);
+
+    FunctionScope localScope(globalScope);
+    try {
+        Ref<Value> res = ast.eval(localScope);
+        if (res && printed) {
+            res->format(*printed);
+        }
+        peakQueryMemory = std::max(peakQueryMemory, context.getPeakMemory());
+        lastReductions = context.getReductions();
+        return res;
+    } catch (...) {
+        peakQueryMemory = std::max(peakQueryMemory, context.getPeakMemory());
+        throw;
+    }
+}
+
+// Top-level queries go through the query cache; whatever value the query has
+// is printed after `prefix`.
+void ListFunc::answer(const Ref<Node>& ast, const char* prefix) {
+    QueryCache::Query query;
+    const bool cacheable = queryCache.prepare(ast, query);
+
+    if (cacheable) {
+        if (const std::string *result = queryCache.find(query)) {
+            output << prefix << *result << '\n';
+            return;
+        }
+    }
+
+    std::string result;
+    if (!evaluate(*ast, &result)) {
+        return;
+    }
+
+    if (cacheable) {
+        queryCache.store(query, result, lastReductions);
+    }
+    output << prefix << result << '\n';
+}
+
+std::string ListFunc::memoryReport() const {
+    return memoryStats().toString() + " peak_query_bytes=" + std::to_string(peakQueryMemory);
+}
+
+// Errors go to stderr unbuffered, after everything printed before them.
+void ListFunc::reportError(const std::string& message) {
+    output.flush();
+    std::cerr << message << std::endl;
+}
+
 int ListFunc::run() {
     std::string line;
 
     while (true) {
+        output.flush();
         std::getline(std::cin, line);
         if (line == "exit" || std::cin.eof()) {
             break;
         } else if (line.empty() || line[0] == '#') {
             continue;
+        } else if (line == ":mem") {
+            output << memoryReport() << '\n';
+            continue;
         }
 
         try {
-            Lexer lexer(line);
-            std::vector<Token> tokens = lexer.lex();
-
-            Parser parser(tokens.begin());
-            FunctionScope localScope(globalScope, nullptr, std::vector<std::shared_ptr<Node>>());
-            std::shared_ptr<Value> val = parser.parse(std::cout)->eval(localScope);
-
-            if (val) {
-                std::cout << ">> " << val->toString() << '\n';
-            }
+            answer(parse(line), ">> ");
         } catch (const std::runtime_error &execException) {
-            std::cerr << execException.what() << std::endl;
+            reportError(execException.what());
             continue;
         } catch (...) {
             return -1;
         }
     }
+    output.flush();
     return 0;
 }
 
@@ -47,28 +123,223 @@ int ListFunc::run(const char* path) {
                 continue;
             }
 
-            std::cout << line << '\n';
+            output << line << '\n';
+            if (line == ":mem") {
+                output << memoryReport() << '\n';
+                continue;
+            }
 
             try {
-                Lexer lexer(line);
-                std::vector<Token> tokens = lexer.lex();
-
-                Parser parser(tokens.begin());
-                FunctionScope localScope(globalScope, nullptr, std::vector<std::shared_ptr<Node>>());
-                std::shared_ptr<Value> val = parser.parse(std::cout)->eval(localScope);
-
-                if (val) {
-                    std::cout << ">> " << val->toString() << '\n';
-                }
+                answer(parse(line), ">> ");
             } catch (const std::runtime_error &execException) {
-                std::cerr << execException.what() << std::endl;
+                reportError(execException.what());
                 continue;
             } catch (...) {
                 return -1;
             }
         }
         file.close();
+        output.flush();
         return 0;
     }
     throw std::runtime_error("Problem while opening file!");
 }
+
+void ListFunc::runQuery(const ScriptQuery& query) {
+    output << query.text << '\n';
+
+    try {
+        answer(query.ast, ">> ");
+    } catch (const std::runtime_error &execException) {
+        reportError(execException.what());
+    }
+}
+
+// Watched scripts are treated as a set of definitions plus queries: the last
+// definition of a function wins and queries run against the final state.
+// Only lines whose text changed are parsed again, and a query is re-run only
+// if it is new or reaches a changed definition through the call graph.
+void ListFunc::reloadScript(const char* path, WatchedScript& script) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        throw std::runtime_error("Problem while opening file!");
+    }
+
+    WatchedScript next;
+    std::map<FunctionKey, Ref<FunctionDefinition>> parsedDefinitions;
+    // Line number of the winning definition of each function.
+    std::map<FunctionKey, size_t> positions;
+    std::vector<ScriptQuery> queries;
+    std::string line;
+
+    for (size_t lineNumber = 1; std::getline(file, line); ++lineNumber) {
+        if (line == "exit") {
+            break;
+        }
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        const auto known = script.definitionLines.find(line);
+        if (known != script.definitionLines.end()) {
+            next.definitionLines[line] = known->second;
+            next.definitionTexts[known->second] = line;
+            positions[known->second] = lineNumber;
+            continue;
+        }
+
+        try {
+            Lexer lexer(line);
+            std::vector<Token> tokens = lexer.lex();
+
+            Parser parser(tokens.begin());
+            Ref<Node> ast = parser.parse(std::cout);
+
+            if (FunctionDefinition *def = ast->as<FunctionDefinition>()) {
+                const FunctionKey key(def->token.data, def->getArgc());
+
+                next.definitionLines[line] = key;
+                next.definitionTexts[key] = line;
+                positions[key] = lineNumber;
+                parsedDefinitions[key] = Ref<FunctionDefinition>(def);
+            }
+            else {
+                ScriptQuery query = {line, ast, {}};
+                collectCalls(ast, query.calls);
+                queries.push_back(query);
+            }
+        } catch (const std::runtime_error &parseException) {
+            reportError(line + '\n' + parseException.what());
+        }
+    }
+
+    std::set<FunctionKey> changed;
+    for (const auto &def : next.definitionTexts) {
+        const auto previous = script.definitionTexts.find(def.first);
+        if (previous == script.definitionTexts.end() || previous->second != def.second) {
+            changed.insert(def.first);
+        }
+    }
+    for (const auto &def : script.definitionTexts) {
+        if (next.definitionTexts.find(def.first) == next.definitionTexts.end()) {
+            changed.insert(def.first);
+        }
+    }
+
+    // Removals first, then definitions in source order. One that is rejected
+    // because of what it calls may pass once its callees are in, so rejected
+    // definitions are retried at the end and only those still rejected then
+    // are reported.
+    std::vector<FunctionKey> order(changed.begin(), changed.end());
+    std::stable_sort(order.begin(), order.end(), [&positions](const FunctionKey &fst, const FunctionKey &snd) {
+        const auto fstPosition = positions.find(fst), sndPosition = positions.find(snd);
+        return (fstPosition == positions.end() ? 0 : fstPosition->second) < (sndPosition == positions.end() ? 0 : sndPosition->second);
+    });
+
+    std::set<FunctionKey> affected = changed;
+    std::map<FunctionKey, std::string> rejections;
+    for (const FunctionKey &key : order) {
+        const auto parsed = parsedDefinitions.find(key);
+        try {
+            if (parsed != parsedDefinitions.end()) {
+                globalScope.addFunction(parsed->second);
+            }
+            else if (next.definitionTexts.find(key) == next.definitionTexts.end()) {
+                globalScope.removeFunction(key);
+            }
+            else {
+                // Same text as before, now on the winning line for this key.
+                Lexer lexer(next.definitionTexts[key]);
+                std::vector<Token> tokens = lexer.lex();
+                Parser parser(tokens.begin());
+                globalScope.addFunction(Ref<FunctionDefinition>(parser.parse(std::cout)->as<FunctionDefinition>()));
+            }
+        } catch (const std::runtime_error &definitionException) {
+            rejections[key] = definitionException.what();
+        }
+
+        const std::set<FunctionKey> dependents = globalScope.dependentsOf(key);
+        affected.insert(dependents.begin(), dependents.end());
+    }
+    for (const FunctionKey &key : globalScope.retryRejected()) {
+        const std::set<FunctionKey> dependents = globalScope.dependentsOf(key);
+        affected.insert(key);
+        affected.insert(dependents.begin(), dependents.end());
+    }
+    for (const auto &rejection : rejections) {
+        if (globalScope.isRejected(rejection.first)) {
+            reportError(next.definitionTexts[rejection.first] + '\n' + rejection.second);
+        }
+    }
+
+    size_t rerun = 0;
+    for (const ScriptQuery &query : queries) {
+        bool stale = script.queryTexts.find(query.text) == script.queryTexts.end();
+
+        for (auto it = query.calls.begin(); !stale && it != query.calls.end(); ++it) {
+            stale = affected.count(*it) != 0;
+        }
+
+        next.queryTexts.insert(query.text);
+        if (stale) {
+            runQuery(query);
+            ++rerun;
+        }
+    }
+
+    output << "-- " << changed.size() << " definition(s) changed, " << rerun << " quer" << (rerun == 1 ? "y" : "ies") << " re-run, " << std::to_string(memoryStats().total().liveBytes) << " bytes live\n";
+    output.flush();
+    script = std::move(next);
+}
+
+int ListFunc::watch(const char* path) {
+#ifdef __linux__
+    const std::string fullPath(path);
+    const size_t slash = fullPath.find_last_of('/');
+    const std::string dir = slash == std::string::npos ? "." : fullPath.substr(0, slash + 1);
+    const std::string name = slash == std::string::npos ? fullPath : fullPath.substr(slash + 1);
+
+    // Editors usually save by writing a temporary file and renaming it over
+    // the original, so the directory is watched rather than the file itself.
+    const int fd = inotify_init1(IN_CLOEXEC);
+    if (fd < 0 || inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0) {
+        throw std::runtime_error("Could not watch " + fullPath);
+    }
+
+    WatchedScript script;
+    reloadScript(path, script);
+
+    alignas(inotify_event) char buffer[4096];
+    while (true) {
+        ssize_t len = read(fd, buffer, sizeof(buffer));
+        if (len <= 0) {
+            close(fd);
+            return -1;
+        }
+
+        bool touched = false;
+        for (char *ptr = buffer; ptr < buffer + len;) {
+            const inotify_event *event = reinterpret_cast<const inotify_event*>(ptr);
+
+            touched = touched || (event->len > 0 && name == event->name);
+            ptr += sizeof(inotify_event) + event->len;
+        }
+
+        if (!touched) {
+            continue;
+        }
+
+        // A single save can produce a burst of events; settle before reloading.
+        pollfd pfd = {fd, POLLIN, 0};
+        while (poll(&pfd, 1, 50) > 0 && read(fd, buffer, sizeof(buffer)) > 0) {}
+
+        try {
+            reloadScript(path, script);
+        } catch (const std::runtime_error &reloadException) {
+            reportError(reloadException.what());
+        }
+    }
+#else
+    throw std::runtime_error("--watch is only supported on Linux");
+#endif
+}
\ No newline at end of file
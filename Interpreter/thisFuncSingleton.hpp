@@ -1,11 +1,25 @@
 #pragma once
 
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "evaluation.hpp"
 #include "lexer.hpp"
+#include "outputBuffer.hpp"
 #include "parser.hpp"
 #include "interpreter.hpp"
+#include "queryCache.hpp"
 
+// One interpreter session. The command line drives the process-wide
+// instance; the server creates one session per client on top of a shared
+// library session.
 class ListFunc {
 public:
+    ListFunc();
+    explicit ListFunc(const GlobalScope* library);
+
     ListFunc(const ListFunc& other) = delete;
     ListFunc& operator=(const ListFunc& other) = delete;
 
@@ -14,12 +28,70 @@ public:
         return object;
     }
 
+    // Evaluates one line under this session's budget. Definitions yield a
+    // null value. A value is also formatted into `printed` if given, under
+    // the same budget, since printing a huge value can take long as well.
+    Ref<Value> evaluate(const std::string& line, std::string* printed = nullptr);
+
+    void setBudget(const EvalBudget& budget) { this->budget = budget; }
+    const EvalBudget& getBudget() const { return budget; }
+
+    // Live memory of the process plus the largest growth of a single query
+    // in this session, as printed by ":mem".
+    std::string memoryReport() const;
+
+    // Keeps query results in `path` across runs, see queryCache.hpp.
+    void attachQueryCache(const std::string& path) { queryCache.attachFile(path); }
+
+    GlobalScope& getGlobalScope() { return globalScope; }
+    const GlobalScope& getGlobalScope() const { return globalScope; }
+
     int run();
     int run(const char* path);
+    // Runs the script's queries on `shards` forked worker processes and
+    // prints the results in source order, see shardedRunner.cpp.
+    int run(const char* path, size_t shards);
+    // Queries piped in by another program, see pipedRunner.cpp: each value is
+    // printed on a line of its own, without echo or ">> " prefix.
+    int runPiped();
+    int watch(const char* path);
 
 private:
+    struct ScriptQuery {
+        std::string text;
+        Ref<Node> ast;
+        std::set<FunctionKey> calls;
+    };
+
+    // What the last (re)load of a watched script left behind.
+    struct WatchedScript {
+        std::map<std::string, FunctionKey> definitionLines;
+        std::map<FunctionKey, std::string> definitionTexts;
+        std::set<std::string> queryTexts;
+    };
+
+    // A script line parsed by the parent of a sharded run. ":mem" has no AST.
+    struct ShardLine {
+        std::string text;
+        Ref<Node> ast;
+        std::string error;
+    };
+
+    // False once the input asks to stop.
+    bool runPipedLine(const std::string& line, std::vector<Token>& tokens);
+    void serveShard(const std::vector<ShardLine>& lines, int commandFd, int replyFd);
+    void reloadScript(const char* path, WatchedScript& script);
+    void runQuery(const ScriptQuery& query);
+    void answer(const Ref<Node>& ast, const char* prefix);
+    static Ref<Node> parse(const std::string& line);
+    void reportError(const std::string& message);
+    Ref<Value> evaluate(const Node& ast, std::string* printed = nullptr);
+
     GlobalScope globalScope;
-    ListFunc() {
-        globalScope.loadDefaultLibrary();
-    }
+    QueryCache queryCache{globalScope};
+    OutputBuffer output{std::cout};
+    EvalBudget budget = {0, std::chrono::milliseconds(0), defaultMaxDepth, 0, nullptr};
+    int64_t peakQueryMemory = 0;
+    // Calls made by the last query that succeeded.
+    uint64_t lastReductions = 0;
 };
\ No newline at end of file
@@ -0,0 +1,91 @@
+#include <stdexcept>
+#include <vector>
+
+#include "parser.hpp"
+#include "strictness.hpp"
+#include "typeInference.hpp"
+
+ValueKind resultKind(const Ref<Node>& node, const GlobalScope& globalScope, const std::map<FunctionKey, ValueKind>& assumed) {
+    switch (node->kind) {
+    case Node::Kind::INT:
+        return ValueKind::INT;
+    case Node::Kind::DOUBLE:
+        return ValueKind::REAL;
+    case Node::Kind::LIST_LITERAL:
+        return ValueKind::LIST;
+    case Node::Kind::FUNCTION_APPLICATION:
+    {
+        const std::vector<Ref<Node>> &args = node->as<FunctionApplication>()->arguments;
+        std::vector<ValueKind> kinds;
+        for (const Ref<Node> &arg : args) {
+            kinds.push_back(resultKind(arg, globalScope, assumed));
+        }
+
+        const char *error;
+        return callResultKind(FunctionKey(node->token.data, args.size()), kinds.data(), globalScope, assumed, error);
+    }
+    default:
+        return ValueKind::UNKNOWN;
+    }
+}
+
+ValueKind callResultKind(const FunctionKey& callee, const ValueKind* args, const GlobalScope& globalScope, const std::map<FunctionKey, ValueKind>& assumed, const char*& error) {
+    error = nullptr;
+
+    const auto known = assumed.find(callee);
+    if (known != assumed.end()) {
+        return known->second;
+    }
+
+    const FunctionDefinition *def = globalScope.findDefinition(callee.first, callee.second);
+    if (!def) {
+        return ValueKind::UNKNOWN;
+    }
+    if (const DefaultFunctionNode *builtin = def->definition->as<DefaultFunctionNode>()) {
+        return builtinResultKind(builtin->id, args, error);
+    }
+    return def->resultKind;
+}
+
+namespace {
+
+// `reached` is whether every evaluation of the body evaluates `node`: the
+// body itself, list elements, and the arguments a reached call is strict in.
+void checkNode(const Ref<Node>& node, bool reached, const GlobalScope& globalScope, const std::map<FunctionKey, ValueKind>& assumed) {
+    if (const ListLiteralNode *list = node->as<ListLiteralNode>()) {
+        for (const Ref<Node> &item : list->contents) {
+            checkNode(item, reached, globalScope, assumed);
+        }
+        return;
+    }
+
+    const FunctionApplication *app = node->as<FunctionApplication>();
+    if (!app) {
+        return;
+    }
+
+    const FunctionKey callee(app->token.data, app->arguments.size());
+    const FunctionDefinition *def = assumed.count(callee) ? nullptr : globalScope.findDefinition(callee.first, callee.second);
+    const DefaultFunctionNode *builtin = def ? def->definition->as<DefaultFunctionNode>() : nullptr;
+    // if() only evaluates its condition for sure.
+    const uint64_t strict = !def ? 0 : builtin && builtin->id == Builtin::IF ? 0b001 : def->strictArguments;
+
+    std::vector<ValueKind> kinds;
+    for (size_t i = 0; i < app->arguments.size(); ++i) {
+        const bool strictIn = i < maxStrictArguments && ((strict >> i) & 1);
+        checkNode(app->arguments[i], reached && strictIn, globalScope, assumed);
+        kinds.push_back(resultKind(app->arguments[i], globalScope, assumed));
+    }
+
+    const char *error;
+    callResultKind(callee, kinds.data(), globalScope, assumed, error);
+    if (reached && error) {
+        throw std::runtime_error(error);
+    }
+}
+
+}
+
+void checkTypes(const Ref<Node>& body, const FunctionKey& key, const GlobalScope& globalScope) {
+    checkNode(body, true, globalScope, {{key, ValueKind::UNKNOWN}});
+}
\ No newline at end of file
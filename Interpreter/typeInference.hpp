@@ -0,0 +1,30 @@
+#pragma once
+
+#include <map>
+
+#include "builtins.hpp"
+#include "interpreter.hpp"
+
+struct Node;
+
+// Type inference over the kinds in ValueKind. Arguments are always
+// UNKNOWN; literals, builtins and the functions they are passed to decide
+// everything else. The kind of a function is what its body yields if it
+// returns at all, so it starts out as NONE and is widened until nothing
+// changes, the same way strictness masks are narrowed (see strictness.hpp).
+
+// Kind of what evaluating `node` yields. Callees listed in `assumed` have
+// that kind; any other callee has the kind of its current definition in
+// `globalScope`, and undefined callees are UNKNOWN.
+ValueKind resultKind(const Ref<Node>& node, const GlobalScope& globalScope, const std::map<FunctionKey, ValueKind>& assumed);
+
+// Kind of what a call of `callee` with arguments of kinds `args` yields,
+// looked up the same way. `error` is set if the callee is a builtin that is
+// certain to reject the arguments.
+ValueKind callResultKind(const FunctionKey& callee, const ValueKind* args, const GlobalScope& globalScope, const std::map<FunctionKey, ValueKind>& assumed, const char*& error);
+
+// Throws if evaluating `body`, about to become the definition of `key`, is
+// sure to call a builtin with arguments it rejects. Only calls that every
+// evaluation of the body reaches count, and nothing is assumed about `key`
+// itself.
+void checkTypes(const Ref<Node>& body, const FunctionKey& key, const GlobalScope& globalScope);
\ No newline at end of file
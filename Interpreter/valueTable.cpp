@@ -0,0 +1,121 @@
+#include <cstring>
+
+#include "valueTable.hpp"
+
+namespace {
+
+bool isIdentical(const Value& fst, const Value& snd) {
+    if (fst.type != snd.type || fst.hash != snd.hash) {
+        return false;
+    }
+
+    switch (fst.type) {
+    case Value::Type::INT_NUMBER:
+        return static_cast<const IntValue&>(fst).value == static_cast<const IntValue&>(snd).value;
+    case Value::Type::BIG_INT_NUMBER:
+        return static_cast<const BigIntValue&>(fst).value == static_cast<const BigIntValue&>(snd).value;
+    case Value::Type::REAL_NUMBER:
+    {
+        const double fstVal = static_cast<const RealValue&>(fst).value;
+        const double sndVal = static_cast<const RealValue&>(snd).value;
+
+        return std::memcmp(&fstVal, &sndVal, sizeof(double)) == 0;
+    }
+    case Value::Type::LIST_LITERAL:
+        // Elements were interned when they were built, so identity is enough.
+        return static_cast<const ListLiteralValue&>(fst).values == static_cast<const ListLiteralValue&>(snd).values;
+    case Value::Type::SEQUENCE:
+        // Sequences are never interned.
+        return false;
+    }
+    return false;
+}
+
+}
+
+Value::~Value() {
+    if (interned) {
+        ValueTable::getInstance().forget(this);
+    }
+}
+
+ValueTable::~ValueTable() {
+    for (auto &entry : entries) {
+        entry.second->interned = false;
+    }
+}
+
+Ref<Value> ValueTable::intern(Ref<Value> value) {
+    if (!enabled) {
+        return value;
+    }
+
+    auto range = entries.equal_range(value->hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (isIdentical(*it->second, *value)) {
+            return Ref<Value>(it->second);
+        }
+    }
+
+    entries.emplace(value->hash, value.get());
+    value->interned = true;
+    return value;
+}
+
+void ValueTable::forget(const Value* value) {
+    auto range = entries.equal_range(value->hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second == value) {
+            entries.erase(it);
+            return;
+        }
+    }
+}
+
+Ref<Value> ValueTable::internInt(int64_t value) {
+    if (!enabled || value < smallIntMin || value >= smallIntMax) {
+        return intern(makeRef<IntValue>(value));
+    }
+
+    if (smallInts.empty()) {
+        for (int i = smallIntMin; i < smallIntMax; ++i) {
+            smallInts.push_back(makeRef<IntValue>(i));
+        }
+    }
+    return smallInts[value - smallIntMin];
+}
+
+Ref<Value> makeInt(int64_t value) {
+    return ValueTable::getInstance().internInt(value);
+}
+
+Ref<Value> makeInteger(const BigInt& value) {
+    if (value.fitsInt64()) {
+        return makeInt(value.toInt64());
+    }
+    return ValueTable::getInstance().intern(makeRef<BigIntValue>(value));
+}
+
+Ref<Value> makeReal(double value) {
+    return ValueTable::getInstance().intern(makeRef<RealValue>(value));
+}
+
+Ref<Value> makeList(const std::vector<Ref<Value>> &values) {
+    return ValueTable::getInstance().intern(makeRef<ListLiteralValue>(values));
+}
+
+Ref<Value> Value::integer(int64_t value) {
+    return makeInt(value);
+}
+
+Ref<Value> Value::integer(const BigInt& value) {
+    return makeInteger(value);
+}
+
+Ref<Value> Value::real(double value) {
+    return makeReal(value);
+}
+
+Ref<Value> Value::list(const std::vector<Ref<Value>> &values) {
+    return makeList(values);
+}
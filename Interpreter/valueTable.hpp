@@ -0,0 +1,47 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include "returnValue.hpp"
+
+#ifndef THISFUNC_HASH_CONS
+#define THISFUNC_HASH_CONS 1
+#endif
+
+// Hash-consing table for immutable values. While enabled, structurally
+// identical numbers and lists built through makeInt/makeReal/makeList share
+// one object, so identical structures compare by pointer. The table does not
+// own its entries: a value removes itself when its last reference goes away.
+class ValueTable {
+public:
+    static ValueTable& getInstance() {
+        thread_local ValueTable table;
+        return table;
+    }
+
+    ~ValueTable();
+
+    bool enabled = THISFUNC_HASH_CONS;
+
+    Ref<Value> intern(Ref<Value> value);
+    Ref<Value> internInt(int64_t value);
+    void forget(const Value* value);
+    size_t size() const { return entries.size(); }
+
+private:
+    ValueTable() = default;
+
+    static constexpr int smallIntMin = -256;
+    static constexpr int smallIntMax = 1024;
+
+    // Small integers are permanently resident and bypass the hash lookup.
+    std::vector<Ref<Value>> smallInts;
+    std::unordered_multimap<size_t, Value*> entries;
+};
+
+Ref<Value> makeInt(int64_t value);
+// Demotes to an IntValue whenever the value fits in int64.
+Ref<Value> makeInteger(const BigInt& value);
+Ref<Value> makeReal(double value);
+Ref<Value> makeList(const std::vector<Ref<Value>> &values);